@@ -27,9 +27,11 @@ extern "C" {
 #include <3ds/gfx.h>
 #include <3ds/console.h>
 #include <3ds/env.h>
+#include <3ds/util/compress.h>
 #include <3ds/util/decompress.h>
 #include <3ds/util/utf.h>
 
+#include <3ds/allocator/stats.h>
 #include <3ds/allocator/linear.h>
 #include <3ds/allocator/mappable.h>
 #include <3ds/allocator/vram.h>
@@ -98,6 +100,7 @@ extern "C" {
 
 #include <3ds/archive.h>
 #include <3ds/romfs.h>
+#include <3ds/prefetch.h>
 #include <3ds/font.h>
 #include <3ds/mii.h>
 
@@ -1,10 +1,14 @@
 /**
  * @file linear.h
  * @brief Linear memory allocator.
+ *
+ * All functions are thread-safe. Small allocations (up to 0x400 bytes) are
+ * served from per-thread caches which don't take the allocator lock.
  */
 #pragma once
 
 #include <stddef.h>
+#include <3ds/allocator/stats.h>
 
 /**
  * @brief Allocates a 0x80-byte aligned buffer.
@@ -23,10 +27,10 @@ void* linearMemAlign(size_t size, size_t alignment);
 
 /**
  * @brief Reallocates a buffer.
- * Note: Not implemented yet.
- * @param mem Buffer to reallocate.
+ * The buffer is grown or shrunk in place when possible; otherwise its contents are moved to a new 0x80-byte aligned buffer.
+ * @param mem Buffer to reallocate, or NULL to allocate a new buffer.
  * @param size Size of the buffer to allocate.
- * @return The reallocated buffer.
+ * @return The reallocated buffer, or NULL on failure (in which case the original buffer is left untouched).
  */
 void* linearRealloc(void* mem, size_t size);
 
@@ -45,5 +49,21 @@ void linearFree(void* mem);
 /**
  * @brief Gets the current linear free space.
  * @return The current linear free space.
+ * @note Space held by the per-thread small allocation caches is not counted as free.
  */
 u32 linearSpaceFree(void);
+
+/**
+ * @brief Retrieves linear memory usage statistics.
+ * @param stats Pointer to output the statistics to.
+ * @note Allocations are counted at their rounded-up size. Free space held by
+ *       the per-thread small allocation caches is not counted as free.
+ */
+void linearGetStats(allocatorStats* stats);
+
+/**
+ * @brief Installs a callback called on every linear allocator event.
+ * @param hook Callback to install, or NULL to remove it.
+ * @param user User data passed to the callback.
+ */
+void linearSetHook(allocatorHook hook, void* user);
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <3ds/types.h>
+#include <3ds/allocator/stats.h>
 
 /**
  * @brief Initializes the mappable allocator.
@@ -25,3 +26,18 @@ void* mappableAlloc(size_t size);
  * @param mem Mappable area to free.
  */
 void mappableFree(void* mem);
+
+/**
+ * @brief Retrieves mappable address space usage statistics.
+ * @param stats Pointer to output the statistics to.
+ * @note Since mappable areas aren't tracked, usage is taken from the memory
+ *       state of the whole range, and the peak only covers calls to this function.
+ */
+void mappableGetStats(allocatorStats* stats);
+
+/**
+ * @brief Installs a callback called on every mappable allocator event.
+ * @param hook Callback to install, or NULL to remove it.
+ * @param user User data passed to the callback.
+ */
+void mappableSetHook(allocatorHook hook, void* user);
@@ -0,0 +1,40 @@
+/**
+ * @file stats.h
+ * @brief Allocator statistics.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <3ds/types.h>
+
+/// Allocator usage statistics.
+typedef struct
+{
+	u32 totalSize;       ///< Size of the managed region.
+	u32 usedSize;        ///< Bytes currently allocated.
+	u32 peakUsedSize;    ///< Highest value reached by usedSize.
+	u32 freeBlocks;      ///< Number of free blocks.
+	u32 largestFree;     ///< Size of the largest free block.
+	float fragmentation; ///< Share of free space outside the largest free block (0 to 1).
+	u32 allocCount;      ///< Number of successful allocations.
+	u32 freeCount;       ///< Number of frees.
+} allocatorStats;
+
+/// Allocator events reported to an \ref allocatorHook.
+typedef enum
+{
+	ALLOCATOR_EVENT_ALLOC  = 0, ///< A buffer was allocated.
+	ALLOCATOR_EVENT_FREE   = 1, ///< A buffer was freed.
+	ALLOCATOR_EVENT_RESIZE = 2, ///< A buffer was resized in place.
+} allocatorEvent;
+
+/**
+ * @brief Allocator event callback.
+ * @param event Event type.
+ * @param mem Buffer the event refers to.
+ * @param size Size of the buffer after the event (or before it, for frees).
+ * @param user User data passed when installing the hook.
+ * @note The hook is called outside of the allocator lock, from the thread that
+ *       made the call, and may itself allocate.
+ */
+typedef void (*allocatorHook)(allocatorEvent event, void* mem, size_t size, void* user);
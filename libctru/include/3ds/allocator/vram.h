@@ -1,9 +1,13 @@
 /**
  * @file vram.h
  * @brief VRAM allocator.
+ *
+ * All functions are thread-safe.
  */
 #pragma once
 
+#include <3ds/allocator/stats.h>
+
 typedef enum vramAllocPos
 {
 	VRAM_ALLOC_A   = BIT(0),
@@ -69,3 +73,17 @@ void vramFree(void* mem);
  * @return The current VRAM free space.
  */
 u32 vramSpaceFree(void);
+
+/**
+ * @brief Retrieves VRAM usage statistics.
+ * @param stats Pointer to output the statistics to.
+ * @note Free blocks are counted across both VRAM banks.
+ */
+void vramGetStats(allocatorStats* stats);
+
+/**
+ * @brief Installs a callback called on every VRAM allocator event.
+ * @param hook Callback to install, or NULL to remove it.
+ * @param user User data passed to the callback.
+ */
+void vramSetHook(allocatorHook hook, void* user);
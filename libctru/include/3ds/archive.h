@@ -5,6 +5,7 @@
 #pragma once
 
 #include <sys/types.h>
+#include <dirent.h>
 
 #include <3ds/types.h>
 #include <3ds/services/fs.h>
@@ -18,6 +19,9 @@ typedef struct
   Handle            fd;             /*! CTRU handle */
   ssize_t           index;          /*! Current entry index */
   size_t            size;           /*! Current batch size */
+  FS_Archive        archive;        /*! Archive the directory belongs to */
+  u16               *path;          /*! UTF-16 path of the directory, to rewind it */
+  u32               path_size;      /*! Size of the path in bytes */
   FS_DirectoryEntry entry_data[32]; /*! Temporary storage for reading entries */
 } archive_dir_t;
 
@@ -39,5 +43,18 @@ Result archiveUnmount(const char *deviceName);
 /// Unmounts all devices and cleans up any resources used by the driver
 Result archiveUnmountAll(void);
 
+/// Enables write-back buffering on a file opened on an archive device (see fileno() for stdio streams).
+/// Adjacent writes are merged in a buffer of the given size and written out with a single FSFILE_Write,
+/// at multiples of the buffer size. The buffer is flushed when full, before reads, fstat, ftruncate
+/// and fsync, and on close. The file size is tracked locally, so O_APPEND writes don't query it.
+/// Passing a size of 0 flushes and disables the buffer. Not supported for files opened with O_SYNC.
+Result archiveSetFileBuffering(int fd, size_t size);
+
+/// Reads a batch of entries from a directory of an archive device opened with opendir().
+/// Entries come straight from FSDIR_Read, with their sizes and attributes, so reading a
+/// directory costs one FS request per batch of maxEntries entries. Can be mixed with readdir().
+/// Sets count to 0 at the end of the directory.
+Result archiveReadDir(DIR *dirp, FS_DirectoryEntry *entries, u32 maxEntries, u32 *count);
+
 /// Get a file's mtime
 Result archive_getmtime(const char *name, u64 *mtime);
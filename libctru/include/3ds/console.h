@@ -34,6 +34,9 @@ extern "C" {
 #define CONSOLE_CYAN    CONSOLE_ESC(36;1m)
 #define CONSOLE_WHITE   CONSOLE_ESC(37;1m)
 
+/// Deferred rendering state of a console (see \ref consoleSetDeferred).
+typedef struct ConsoleBacking ConsoleBacking;
+
 /// A callback for printing a character.
 typedef bool(*ConsolePrint)(void* con, int c);
 
@@ -101,6 +104,10 @@ typedef struct PrintConsole
 	ConsolePrint PrintChar;  ///< Callback for printing a character. Should return true if it has handled rendering the graphics (else the print engine will attempt to render via tiles).
 
 	bool consoleInitialised; ///< True if the console is initialized
+
+	ConsoleBacking* backing; ///< Text cell backing store, or NULL when characters are drawn immediately
+
+	GSPGPU_FramebufferFormat format; ///< Framebuffer format
 }PrintConsole;
 
 #define CONSOLE_COLOR_BOLD	(1<<0) ///< Bold text
@@ -164,12 +171,43 @@ PrintConsole *consoleSelect(PrintConsole* console);
  */
 PrintConsole* consoleInit(gfxScreen_t screen, PrintConsole* console);
 
+/**
+ * @brief Initialise the console with the given framebuffer format.
+ * @param screen The screen to use for the console.
+ * @param console A pointer to the console data to initialize (if it's NULL, the default console will be used).
+ * @param format Framebuffer format: GSP_RGB565_OES, GSP_BGR8_OES or GSP_RGBA8_OES. Other formats fall back to GSP_RGB565_OES.
+ * @return A pointer to the current console.
+ * @remark \ref consoleInit uses GSP_RGB565_OES. The 24 and 32 bit formats allow drawing to the same framebuffer as
+ *         code that expects them, at the cost of writing more memory per character.
+ */
+PrintConsole* consoleInitFormat(gfxScreen_t screen, PrintConsole* console, GSPGPU_FramebufferFormat format);
+
 /**
  * @brief Initializes debug console output on stderr to the specified device.
  * @param device The debug device (or devices) to output debug print statements to.
  */
 void consoleDebugInit(debugDevice device);
 
+/**
+ * @brief Enables or disables deferred rendering.
+ *
+ * In deferred mode, printing only updates a grid of text cells and scrolling only rotates it.
+ * The changed cells are drawn to the framebuffer by \ref consoleFlush, which should be called
+ * once per frame. This is much cheaper than drawing every character as it is printed when a
+ * lot of text is being output.
+ * @param console Console to update, if NULL it will update the current console.
+ * @param enable Whether to enable deferred rendering. Disabling it flushes pending output.
+ * @return False if the backing store could not be allocated.
+ * @note Disable deferred rendering before reinitializing the console with \ref consoleInit.
+ */
+bool consoleSetDeferred(PrintConsole* console, bool enable);
+
+/**
+ * @brief Draws pending output and flushes the framebuffer.
+ * @param console Console to flush, if NULL it will flush the current console.
+ */
+void consoleFlush(PrintConsole* console);
+
 /// Clears the screen by using iprintf("\x1b[2J");
 void consoleClear(void);
 
@@ -49,6 +49,38 @@ static inline void GPUCMD_GetBuffer(u32** addr, u32* size, u32* offset)
 	if(offset)*offset=gpuCmdBufOffset;
 }
 
+/**
+ * @brief Switches to a chained GPU command buffer, which grows as needed.
+ * @param chunkSize Size (in words) of each chunk of the command buffer.
+ * @return false if chained mode is already active or the first chunk could not be allocated.
+ * @remark When a chunk is full, another one is allocated from linear memory and the current
+ *         one ends with a jump to it, so a command list may span several chunks. Chunks are
+ *         reused once the GPU is done with them, see \ref GPUCMD_RecycleChain.
+ * @note \ref GPUCMD_SetBuffer and \ref GPUCMD_SetBufferOffset must not be used in chained mode.
+ */
+bool GPUCMD_SetChainedBuffer(u32 chunkSize);
+
+/**
+ * @brief Leaves chained mode, freeing all the chunks of the chained GPU command buffer.
+ * @note The GPU must not be processing any command list recorded in chained mode.
+ */
+void GPUCMD_FreeChainedBuffer(void);
+
+/**
+ * @brief Gets the fence of the last command list split off the chained GPU command buffer.
+ * @return The fence, to be passed to \ref GPUCMD_RecycleChain once the GPU processed the list.
+ */
+u32 GPUCMD_GetChainFence(void);
+
+/**
+ * @brief Recycles the chunks of the chained GPU command buffer used by processed command lists.
+ * @param fence Fence of the last command list the GPU is done with, as given by \ref GPUCMD_GetChainFence.
+ *        All lists split off before it must also be done.
+ * @remark Chunks in excess of the number just recycled are returned to linear memory, so that the
+ *         memory used follows the size of the lists being recorded.
+ */
+void GPUCMD_RecycleChain(u32 fence);
+
 /**
  * @brief Adds raw GPU commands to the current command buffer.
  * @param cmd Buffer containing commands to add.
@@ -68,9 +100,51 @@ void GPUCMD_Add(u32 header, const u32* param, u32 paramlength);
  * @brief Splits the current GPU command buffer.
  * @param addr Pointer to output the command buffer to.
  * @param size Pointer to output the size (in words) of the command buffer to.
+ * @remark In chained mode, the size is that of the part of the command list in its first
+ *         chunk, which is what \ref GX_ProcessCommandList expects. The parts in the following
+ *         chunks are flushed from the data cache by this function.
  */
 void GPUCMD_Split(u32** addr, u32* size);
 
+/// GPU register shadow statistics.
+typedef struct
+{
+	u32 writes; ///< Number of register writes dropped.
+	u32 bytes;  ///< Number of command buffer bytes saved.
+} GPUCMD_ShadowStats;
+
+/**
+ * @brief Enables or disables the GPU register shadow.
+ * @param enable Whether to enable the shadow.
+ * @return false if the shadow could not be allocated.
+ * @remark While enabled, the last value written to each register through \ref GPUCMD_Add is
+ *         remembered, and writes that would not change any state are dropped. This includes
+ *         float uniform uploads matching the values already uploaded.
+ *         Trigger and data port registers (draw calls, LUT data, shader code transfers, etc.)
+ *         are always written.
+ * @note The shadow assumes the recorded commands are executed by the GPU in recording order,
+ *       and that nothing else changes the GPU registers in between. Call \ref GPUCMD_InvalidateShadow
+ *       whenever this is not the case.
+ * @note Disabling the shadow may add a float uniform pointer write to the current command buffer.
+ */
+bool GPUCMD_EnableShadow(bool enable);
+
+/**
+ * @brief Forgets the state of all the registers remembered by the GPU register shadow.
+ * @remark Must be called after the GPU runs commands that were not recorded through the
+ *         current command buffer (e.g. a foreign command list passed to \ref GX_ProcessCommandList),
+ *         or after the GPU state may have been lost. Commands added with \ref GPUCMD_AddRawCommands
+ *         invalidate the shadow automatically.
+ */
+void GPUCMD_InvalidateShadow(void);
+
+/**
+ * @brief Gets the GPU register shadow statistics.
+ * @param stats Pointer to output the statistics to.
+ * @param reset Whether to reset the statistics afterwards.
+ */
+void GPUCMD_GetShadowStats(GPUCMD_ShadowStats* stats, bool reset);
+
 /**
  * @brief Converts a 32-bit float to a 16-bit float.
  * @param f Float to convert.
@@ -99,6 +173,37 @@ u32 f32tof24(float f);
  */
 u32 f32tof31(float f);
 
+/**
+ * @brief Converts an array of 32-bit floats to 16-bit floats.
+ * @param out Output array.
+ * @param in Floats to convert.
+ * @param count Number of floats to convert.
+ * @remark The results are the same as calling \ref f32tof16 on each float.
+ * @note \p out and \p in must not overlap.
+ */
+void f32tof16Array(u16* out, const float* in, u32 count);
+
+/**
+ * @brief Converts an array of 32-bit floats to 24-bit floats, one per word.
+ * @param out Output array.
+ * @param in Floats to convert.
+ * @param count Number of floats to convert.
+ * @remark The results are the same as calling \ref f32tof24 on each float.
+ * @note \p out and \p in must not overlap.
+ */
+void f32tof24Array(u32* out, const float* in, u32 count);
+
+/**
+ * @brief Converts an array of vectors of 4 32-bit floats (x, y, z, w) to packed 24-bit float vectors.
+ * @param out Output array, receiving 3 words per vector.
+ * @param in Vectors to convert.
+ * @param count Number of vectors to convert.
+ * @remark The output uses the layout expected by the float uniform data registers in 24-bit mode
+ *         (GPUREG_VSH_FLOATUNIFORM_DATA and GPUREG_GSH_FLOATUNIFORM_DATA), and can be sent as is.
+ * @note \p out and \p in must not overlap.
+ */
+void f32tof24Vec4Packed(u32* out, const float* in, u32 count);
+
 /// Adds a command with a single parameter to the current command buffer.
 static inline void GPUCMD_AddSingleParam(u32 header, u32 param)
 {
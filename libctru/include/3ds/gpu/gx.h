@@ -155,6 +155,9 @@ Result GX_RequestDma(u32* src, u32* dst, u32 length);
  * @param buf0a Command list address.
  * @param buf0s Command list size.
  * @param flags Flags to process with.
+ * @note If the list was not recorded through the current GPU command buffer while the GPU
+ *       register shadow is enabled, call \ref GPUCMD_InvalidateShadow afterwards. Likewise, call
+ *       \ref shaderProgramInvalidateResident if such a list uploads shader code.
  */
 Result GX_ProcessCommandList(u32* buf0a, u32 buf0s, u8 flags);
 
@@ -35,6 +35,13 @@ typedef struct
 	u8 geoShaderInputStride;          ///< Geometry shader input stride.
 }shaderProgram_s;
 
+/// Statistics about shader code uploads skipped by \ref shaderProgramUse.
+typedef struct
+{
+	u32 uploads; ///< Number of code and operand descriptor uploads skipped.
+	u32 words;   ///< Number of command words saved by skipping them.
+}shaderUploadStats_s;
+
 /**
  * @brief Initializes a shader instance.
  * @param si Shader instance to initialize.
@@ -71,6 +78,18 @@ Result shaderInstanceGetBool(shaderInstance_s* si, int id, bool* value);
  */
 s8 shaderInstanceGetUniformLocation(shaderInstance_s* si, const char* name);
 
+/**
+ * @brief Gets the locations of several of a shader's uniforms.
+ * @param si Shader instance to use.
+ * @param names Names of the uniforms.
+ * @param locations Array to output the locations to (-1 for uniforms that don't exist).
+ * @param count Number of uniforms to look up.
+ * @return The number of uniforms found.
+ * @remark Resolving all the uniforms used by a renderer once, and keeping the locations around,
+ *         avoids looking them up by name on every draw.
+ */
+int shaderInstanceGetUniformLocations(shaderInstance_s* si, const char* const* names, s8* locations, int count);
+
 /**
  * @brief Initializes a shader program.
  * @param sp Shader program to initialize.
@@ -114,7 +133,26 @@ Result shaderProgramSetGshInputPermutation(shaderProgram_s* sp, u64 permutation)
 Result shaderProgramConfigure(shaderProgram_s* sp, bool sendVshCode, bool sendGshCode);
 
 /**
- * @brief Same as shaderProgramConfigure, but always loading code/operand descriptors and uploading DVLE constants afterwards.
+ * @brief Same as shaderProgramConfigure, but loading code/operand descriptors as needed and uploading DVLE constants afterwards.
  * @param sp Shader program to use.
+ * @remark The library keeps track of the DVLP last uploaded to each shader unit by \ref shaderProgramConfigure,
+ *         and code/operand descriptors that are already resident are not uploaded again.
+ * @note Resident code tracking assumes command lists are executed in the order they are recorded.
+ *       Call \ref shaderProgramInvalidateResident if shader memory may have been overwritten by other means.
  */
 Result shaderProgramUse(shaderProgram_s* sp);
+
+/**
+ * @brief Forgets which shader code is resident in the shader units.
+ * @param dvlp DVLP to forget, or NULL to forget all resident code.
+ * @remark Use this after running command lists not recorded through this library, after the GPU state
+ *         may have been lost, or after modifying a DVLP's code in place. \ref DVLB_Free does this automatically.
+ */
+void shaderProgramInvalidateResident(const DVLP_s* dvlp);
+
+/**
+ * @brief Gets statistics about shader code uploads skipped because the code was already resident.
+ * @param stats Pointer to output the statistics to (can be NULL).
+ * @param reset Whether to reset the statistics afterwards.
+ */
+void shaderProgramGetUploadStats(shaderUploadStats_s* stats, bool reset);
@@ -92,6 +92,8 @@ typedef struct{
 	u32 outmapData[8];                     ///< Output map data.
 	u32 outmapMode;                        ///< Output map mode.
 	u32 outmapClock;                       ///< Output map attribute clock.
+	u32* uniformHash;                      ///< Uniform name hash index (NULL if not available).
+	u32 uniformHashMask;                   ///< Uniform name hash index size minus one.
 }DVLE_s;
 
 /// DVLB data.
@@ -119,10 +121,21 @@ void DVLB_Free(DVLB_s* dvlb);
  * @brief Gets a uniform register index from a shader.
  * @param dvle Shader to get the register from.
  * @param name Name of the register.
- * @return The uniform register index.
+ * @return The uniform register index, or -1 if the uniform doesn't exist.
+ * @remark Shaders parsed by \ref DVLB_ParseFile are looked up through a hash index of the uniform names.
  */
 s8 DVLE_GetUniformRegister(DVLE_s* dvle, const char* name);
 
+/**
+ * @brief Gets the register indices of several uniforms from a shader.
+ * @param dvle Shader to get the registers from.
+ * @param names Names of the registers.
+ * @param regs Array to output the uniform register indices to (-1 for uniforms that don't exist).
+ * @param count Number of registers to look up.
+ * @return The number of uniforms found.
+ */
+int DVLE_GetUniformRegisters(DVLE_s* dvle, const char* const* names, s8* regs, int count);
+
 /**
  * @brief Generates a shader output map.
  * @param dvle Shader to generate an output map for.
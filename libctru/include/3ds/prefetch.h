@@ -0,0 +1,78 @@
+/**
+ * @file prefetch.h
+ * @brief Asynchronous file prefetching.
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <3ds/types.h>
+#include <3ds/synchronization.h>
+
+/// Default number of prefetch worker threads.
+#define PREFETCH_DEFAULT_THREADS 2
+
+/// Maximum number of requests waiting for a worker at any time.
+#define PREFETCH_MAX_PENDING 0x4000
+
+typedef struct prefetchRequest prefetchRequest;
+
+/**
+ * @brief Prefetch completion callback.
+ * @param req Completed request.
+ * @note Called from a worker thread, before \ref prefetchIsDone returns true for the request.
+ */
+typedef void (*prefetchCallback)(prefetchRequest* req);
+
+/// Prefetch request.
+struct prefetchRequest
+{
+	const char* path;          ///< Path of the file, including the device name (e.g. "romfs:/level1.bin").
+	u64 offset;                ///< Offset to start reading from.
+	size_t size;               ///< Number of bytes to read.
+	void* buffer;              ///< Buffer receiving the data.
+	prefetchCallback callback; ///< Completion callback, or NULL.
+	LightEvent* event;         ///< Event to signal on completion, or NULL.
+	void* user;                ///< User data.
+	ssize_t result;            ///< Number of bytes read (less than size at the end of the file), or -1 on failure.
+	int error;                 ///< errno value on failure.
+	bool done;                 ///< Whether the request has completed.
+	prefetchRequest* next;     ///< Internal use.
+};
+
+/**
+ * @brief Starts the prefetch worker threads.
+ * @param threadCount Number of worker threads, or 0 for \ref PREFETCH_DEFAULT_THREADS.
+ * @param prio Priority of the worker threads.
+ * @remark Calls are reference counted; only the first one creates the threads.
+ */
+Result prefetchInit(u32 threadCount, int prio);
+
+/// Completes all pending requests, then stops the prefetch worker threads.
+void prefetchExit(void);
+
+/**
+ * @brief Queues requests for reading by the worker threads.
+ * @param reqs Requests to queue. They must stay valid until they complete.
+ * @param count Number of requests.
+ * @remark Requests are started in order, so a caller waiting for them in order can process
+ *         the data of one file while the next ones are being read. Files are accessed through
+ *         the regular devoptab interface, so any mounted device can be read this way
+ *         (e.g. romfs or archive devices).
+ */
+Result prefetchSubmit(prefetchRequest* reqs, size_t count);
+
+/**
+ * @brief Checks whether a request has completed.
+ * @param req Request to check.
+ */
+static inline bool prefetchIsDone(const prefetchRequest* req)
+{
+	return __atomic_load_n(&req->done, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Waits for a request to complete.
+ * @param req Request to wait for.
+ * @return Number of bytes read, or -1 on failure (see the request's error field).
+ */
+ssize_t prefetchWait(prefetchRequest* req);
@@ -46,6 +46,35 @@ typedef struct
 	u16 name[];   ///< Name. (UTF-16)
 } romfs_file;
 
+/// RomFS read cache settings.
+typedef struct
+{
+	u32  blockSize;      ///< Size of a cache block, a power of two no smaller than 0x200.
+	u32  budget;         ///< Memory used by the cache, in bytes. 0 disables the cache.
+	u32  readAhead;      ///< Number of blocks to fetch ahead of sequential reads.
+	bool cacheByDefault; ///< Whether files opened from now on use the cache.
+} romfs_cache_config;
+
+/// RomFS mount flags.
+enum
+{
+	ROMFS_MOUNT_LAZY   = BIT(0), ///< Read metadata on demand through the read cache instead of loading it at mount time.
+	ROMFS_MOUNT_LINEAR = BIT(1), ///< Allocate the metadata tables from linear memory instead of the heap.
+};
+
+/**
+ * @brief Sets the flags used by subsequent RomFS mounts.
+ * @param flags Bitmask of ROMFS_MOUNT_* flags.
+ * @remark With \ref ROMFS_MOUNT_LAZY, mounting only reads the header: directory and file
+ *         entries are fetched as lookups reach them, through the mount's read cache (64 KiB
+ *         by default, see \ref romfsSetCache), so memory use stays bounded and mount time no
+ *         longer depends on the size of the image. Disabling the cache of such a mount makes
+ *         every entry access an FS request. Entries whose names are longer than NAME_MAX
+ *         can't be looked up on lazily loaded mounts. Neither flag affects mounts made with
+ *         \ref romfsMountFromMemory, except for tables that have to be copied out of the image.
+ */
+void romfsSetMountFlags(u32 flags);
+
 /**
  * @brief Mounts the Application's RomFS.
  * @param name Device mount name.
@@ -63,6 +92,16 @@ Result romfsMountSelf(const char *name);
  */
 Result romfsMountFromFile(Handle fd, u32 offset, const char *name);
 
+/**
+ * @brief Mounts RomFS from an image in memory.
+ * @param image RomFS image, which must stay valid until the device is unmounted.
+ * @param size Size of the image.
+ * @param name Device mount name.
+ * @remark Reads are served with memcpy and never go through FS. If the image is 4-byte
+ *         aligned, its metadata tables are used in place rather than copied.
+ */
+Result romfsMountFromMemory(const void *image, size_t size, const char *name);
+
 /**
  * @brief Mounts RomFS using the current process host program RomFS.
  * @param name Device mount name.
@@ -77,6 +116,58 @@ Result romfsMountFromCurrentProcess(const char *name);
  */
 Result romfsMountFromTitle(u64 tid, FS_MediaType mediatype, const char* name);
 
+/**
+ * @brief Configures the read cache of a mounted RomFS.
+ * @param name Device mount name.
+ * @param config Cache settings, or NULL to disable the cache.
+ * @remark Reads that go through the cache are served from an LRU set of blocks of the image,
+ *         so small reads of neighbouring files share a single FS request. Reads of whole
+ *         aligned blocks bypass the cache. Read-ahead blocks are staged in a buffer taken
+ *         out of the budget. The cache is never enabled for in-memory images.
+ *         Mounts made with \ref ROMFS_MOUNT_LAZY also read their metadata through it.
+ */
+Result romfsSetCache(const char *name, const romfs_cache_config *config);
+
+/**
+ * @brief Sets whether reads from an open RomFS file go through the mount's read cache.
+ * @param fd File descriptor (see fileno() for stdio streams).
+ * @param enable Whether to use the cache.
+ */
+Result romfsSetFileCaching(int fd, bool enable);
+
+/**
+ * @brief Builds a full path lookup index for a mounted RomFS.
+ * @param name Device mount name.
+ * @param memUsed Pointer to output the memory used by the index to, or NULL.
+ * @remark With the index, opening or stating an absolute path (or a path relative to the root
+ *         while it is the current directory) costs a single hash and compare. Other paths fall
+ *         back to the regular lookup. Rebuilding the index replaces the previous one; it must not
+ *         be done while other threads access the device. The index is freed on unmount.
+ *         Building the index of a lazily loaded mount reads all of its metadata.
+ */
+Result romfsBuildIndex(const char *name, size_t *memUsed);
+
+/**
+ * @brief Loads a whole RomFS file into memory.
+ * @param path Path of the file, optionally prefixed with the device name (defaults to "romfs").
+ * @param alloc Allocator for the buffer (e.g. linearAlloc), or NULL to use malloc.
+ * @param dealloc Deallocator matching \p alloc, used if the read fails. Ignored if \p alloc is NULL.
+ * @param data Pointer to output the read-only buffer to.
+ * @param size Pointer to output the file size to.
+ * @remark The file is read with a single FS request straight into the buffer, with no
+ *         intermediate copy. For devices mounted with \ref romfsMountFromMemory, the
+ *         returned pointer points into the image and nothing is allocated.
+ *         Release it with \ref romfsUnmapFile before unmounting the device.
+ */
+Result romfsMapFile(const char *path, void* (*alloc)(size_t size), void (*dealloc)(void *mem), const void **data, size_t *size);
+
+/**
+ * @brief Releases a buffer returned by \ref romfsMapFile.
+ * @param data Buffer to release.
+ * @param dealloc Deallocator matching the allocator passed to \ref romfsMapFile, or NULL for free.
+ */
+void romfsUnmapFile(const void *data, void (*dealloc)(void *mem));
+
 /// Unmounts the RomFS device.
 Result romfsUnmount(const char *name);
 
@@ -0,0 +1,86 @@
+/**
+ * @file compress.h
+ * @brief Compression functions.
+ */
+#pragma once
+
+#include <3ds/util/decompress.h>
+
+/** @brief Compression levels */
+typedef enum
+{
+  COMPRESS_FAST = 0, ///< Short match search
+  COMPRESS_BEST = 1, ///< Exhaustive match search with lazy matching
+} compressLevel;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** @brief Get the worst-case compressed size
+ *  @param[in] type Compression type
+ *  @param[in] size Uncompressed size
+ *  @returns Maximum compressed size, including the header
+ */
+size_t compressMaxSize(decompressType type, size_t size);
+
+/** @brief Compress LZSS/LZ10
+ *  @param[out] output  Output buffer
+ *  @param[in]  outsize Output size limit
+ *  @param[in]  input   Data to compress
+ *  @param[in]  insize  Size of data to compress
+ *  @param[in]  level   Compression level
+ *  @returns Compressed size, including the header
+ *  @retval -1 error
+ *
+ *  @note The output can be decompressed with decompressV().
+ */
+ssize_t compressLZSS(void *output, size_t outsize, const void *input,
+                     size_t insize, compressLevel level);
+
+/** @brief Compress LZ11
+ *  @param[out] output  Output buffer
+ *  @param[in]  outsize Output size limit
+ *  @param[in]  input   Data to compress
+ *  @param[in]  insize  Size of data to compress
+ *  @param[in]  level   Compression level
+ *  @returns Compressed size, including the header
+ *  @retval -1 error
+ *
+ *  @note The output can be decompressed with decompressV().
+ */
+ssize_t compressLZ11(void *output, size_t outsize, const void *input,
+                     size_t insize, compressLevel level);
+
+/** @brief Compress Huffman
+ *  @param[in]  bits    Data size in bits (1 to 8)
+ *  @param[out] output  Output buffer
+ *  @param[in]  outsize Output size limit
+ *  @param[in]  input   Data to compress
+ *  @param[in]  insize  Size of data to compress
+ *  @returns Compressed size, including the header
+ *  @retval -1 error
+ *
+ *  @note Each input byte is one symbol, so every byte must fit in \a bits.
+ *        The output can be decompressed with decompressV().
+ */
+ssize_t compressHuff(size_t bits, void *output, size_t outsize,
+                     const void *input, size_t insize);
+
+/** @brief Compress run-length encoding
+ *  @param[out] output  Output buffer
+ *  @param[in]  outsize Output size limit
+ *  @param[in]  input   Data to compress
+ *  @param[in]  insize  Size of data to compress
+ *  @returns Compressed size, including the header
+ *  @retval -1 error
+ *
+ *  @note The output can be decompressed with decompressV().
+ */
+ssize_t compressRLE(void *output, size_t outsize, const void *input,
+                    size_t insize);
+
+#ifdef __cplusplus
+}
+#endif
@@ -38,6 +38,17 @@ typedef struct
 typedef ssize_t (*decompressCallback)(void *userdata, void *buffer,
                                       size_t size);
 
+/** @brief Streaming decompression status */
+typedef enum
+{
+  DECOMPRESS_STREAM_ERROR = -1, ///< Stream is malformed
+  DECOMPRESS_STREAM_MORE  =  0, ///< More input or output space is needed
+  DECOMPRESS_STREAM_DONE  =  1, ///< All output has been produced
+} decompressStreamStatus;
+
+/** @brief Streaming decompression context (see decompressStreamCreate()) */
+typedef struct decompressStream decompressStream;
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -138,6 +149,19 @@ decompress_LZSS(void *output, size_t size, decompressCallback callback,
   return decompressV_LZSS(&iov, 1, callback, userdata, insize);
 }
 
+/** @brief Decompress LZSS/LZ10 from memory
+ *  @param[in] output Output buffer
+ *  @param[in] size   Output size limit
+ *  @param[in] input  Compressed data
+ *  @param[in] insize Size of compressed data
+ *  @returns Whether succeeded
+ *
+ *  @note Both buffers are bounds-checked, and back-references before the
+ *        start of the output fail.
+ */
+bool decompress_LZSS_mem(void *output, size_t size, const void *input,
+                         size_t insize);
+
 /** @brief Decompress LZ11
  *  @param[in] iov      Output vector
  *  @param[in] iovcnt   Number of buffers
@@ -169,6 +193,19 @@ decompress_LZ11(void *output, size_t size, decompressCallback callback,
   return decompressV_LZ11(&iov, 1, callback, userdata, insize);
 }
 
+/** @brief Decompress LZ11 from memory
+ *  @param[in] output Output buffer
+ *  @param[in] size   Output size limit
+ *  @param[in] input  Compressed data
+ *  @param[in] insize Size of compressed data
+ *  @returns Whether succeeded
+ *
+ *  @note Both buffers are bounds-checked, and back-references before the
+ *        start of the output fail.
+ */
+bool decompress_LZ11_mem(void *output, size_t size, const void *input,
+                         size_t insize);
+
 /** @brief Decompress Huffman
  *  @param[in] bits     Data size in bits (usually 4 or 8)
  *  @param[in] iov      Output vector
@@ -233,6 +270,54 @@ decompress_RLE(void *output, size_t size, decompressCallback callback,
   return decompressV_RLE(&iov, 1, callback, userdata, insize);
 }
 
+/** @brief Create a streaming decompression context
+ *  @returns Streaming decompression context
+ *  @retval NULL out of memory
+ *
+ *  @note The context holds the LZ sliding window and the Huffman tree, so
+ *        compressed data can be decoded incrementally into small output
+ *        windows. The header is read from the start of the input.
+ */
+decompressStream* decompressStreamCreate(void);
+
+/** @brief Reset a streaming decompression context to decode a new stream
+ *  @param[in] stream Streaming decompression context
+ */
+void decompressStreamReset(decompressStream *stream);
+
+/** @brief Free a streaming decompression context
+ *  @param[in] stream Streaming decompression context
+ */
+void decompressStreamFree(decompressStream *stream);
+
+/** @brief Get the decoded header of a stream
+ *  @param[in]  stream Streaming decompression context
+ *  @param[out] type   Decompression type
+ *  @param[out] size   Decompressed size
+ *  @returns Whether the header has been decoded
+ */
+bool decompressStreamHeader(const decompressStream *stream,
+                            decompressType *type, size_t *size);
+
+/** @brief Decompress a chunk of a stream
+ *  @param[in]  stream  Streaming decompression context
+ *  @param[in]  input   Input chunk
+ *  @param[in]  insize  Input chunk size
+ *  @param[out] inused  Bytes of input consumed
+ *  @param[in]  output  Output window
+ *  @param[in]  outsize Output window size
+ *  @param[out] outused Bytes written to output
+ *  @returns Decompression status
+ *
+ *  @note Input is consumed and output produced until either runs out. When
+ *        DECOMPRESS_STREAM_MORE is returned, call again with the unconsumed
+ *        input and/or a fresh output window.
+ */
+decompressStreamStatus decompressStreamRun(decompressStream *stream,
+                                           const void *input, size_t insize,
+                                           size_t *inused, void *output,
+                                           size_t outsize, size_t *outused);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,19 +1,15 @@
 #pragma once
 
+// Allocated blocks are indexed by address through the tree node embedded in
+// their descriptor, so tracking an allocation needs no extra memory
 static rbtree_t sAddrMap;
 
-struct addrMapNode
-{
-	rbtree_node node;
-	MemChunk chunk;
-};
-
-#define getAddrMapNode(x) rbtree_item((x), addrMapNode, node)
+#define getAddrMapBlock(x) rbtree_item((x), MemBlock, node)
 
 static int addrMapNodeComparator(const rbtree_node_t* _lhs, const rbtree_node_t* _rhs)
 {
-	auto lhs = getAddrMapNode(_lhs)->chunk.addr;
-	auto rhs = getAddrMapNode(_rhs)->chunk.addr;
+	auto lhs = getAddrMapBlock(_lhs)->base;
+	auto rhs = getAddrMapBlock(_rhs)->base;
 	if (lhs < rhs)
 		return -1;
 	if (lhs > rhs)
@@ -21,28 +17,20 @@ static int addrMapNodeComparator(const rbtree_node_t* _lhs, const rbtree_node_t*
 	return 0;
 }
 
-static void addrMapNodeDestructor(rbtree_node_t* a)
-{
-	free(getAddrMapNode(a));
-}
-
-static addrMapNode* getNode(void* addr)
+static MemBlock* getBlock(void* addr)
 {
-	addrMapNode n;
-	n.chunk.addr = (u8*)addr;
-	auto p = rbtree_find(&sAddrMap, &n.node);
-	return p ? getAddrMapNode(p) : nullptr;
+	MemBlock b;
+	b.base = (u8*)addr;
+	auto p = rbtree_find(&sAddrMap, &b.node);
+	return p ? getAddrMapBlock(p) : nullptr;
 }
 
-static addrMapNode* newNode(const MemChunk& chunk)
+static void addBlock(MemBlock* b)
 {
-	auto p = (addrMapNode*)malloc(sizeof(addrMapNode));
-	if (!p) return nullptr;
-	p->chunk = chunk;
-	return p;
+	rbtree_insert(&sAddrMap, &b->node);
 }
 
-static void delNode(addrMapNode* node)
+static void delBlock(MemBlock* b)
 {
-	rbtree_remove(&sAddrMap, &node->node, addrMapNodeDestructor);
+	rbtree_remove(&sAddrMap, &b->node, nullptr);
 }
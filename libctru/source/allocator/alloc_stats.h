@@ -0,0 +1,76 @@
+#pragma once
+#include <3ds/types.h>
+#include <3ds/allocator/stats.h>
+
+// Hook and user data, published together so that a notifier can't pair
+// a hook with the user data of another one (8 bytes, ldrexd/strexd on ARM11)
+typedef struct
+{
+	allocatorHook hook;
+	void* user;
+} __attribute__((aligned(8))) allocStatsHook;
+
+// Counters shared by the allocators; updated atomically since parts of the
+// allocators run without a lock
+typedef struct
+{
+	u32 used, peak;
+	u32 allocs, frees;
+	allocStatsHook hook;
+} allocStatsState;
+
+static inline void allocStatsSetHook(allocStatsState* s, allocatorHook hook, void* user)
+{
+	allocStatsHook h = { hook, user };
+	__atomic_store(&s->hook, &h, __ATOMIC_RELEASE);
+}
+
+static inline void allocStatsNotify(allocStatsState* s, allocatorEvent event, void* mem, u32 size)
+{
+	allocStatsHook h;
+	__atomic_load(&s->hook, &h, __ATOMIC_ACQUIRE);
+	if (h.hook)
+		h.hook(event, mem, size, h.user);
+}
+
+static inline void allocStatsGrow(allocStatsState* s, u32 size)
+{
+	u32 used = __atomic_add_fetch(&s->used, size, __ATOMIC_RELAXED);
+	u32 peak = __atomic_load_n(&s->peak, __ATOMIC_RELAXED);
+	while (used > peak && !__atomic_compare_exchange_n(&s->peak, &peak, used, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static inline void allocStatsAlloc(allocStatsState* s, void* mem, u32 size)
+{
+	allocStatsGrow(s, size);
+	__atomic_add_fetch(&s->allocs, 1, __ATOMIC_RELAXED);
+	allocStatsNotify(s, ALLOCATOR_EVENT_ALLOC, mem, size);
+}
+
+static inline void allocStatsFree(allocStatsState* s, void* mem, u32 size)
+{
+	__atomic_sub_fetch(&s->used, size, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&s->frees, 1, __ATOMIC_RELAXED);
+	allocStatsNotify(s, ALLOCATOR_EVENT_FREE, mem, size);
+}
+
+static inline void allocStatsResize(allocStatsState* s, void* mem, u32 oldSize, u32 newSize)
+{
+	if (newSize > oldSize)
+		allocStatsGrow(s, newSize - oldSize);
+	else
+		__atomic_sub_fetch(&s->used, oldSize - newSize, __ATOMIC_RELAXED);
+	allocStatsNotify(s, ALLOCATOR_EVENT_RESIZE, mem, newSize);
+}
+
+static inline void allocStatsFill(allocStatsState* s, allocatorStats* out, u32 total, u32 freeSpace, u32 freeBlocks, u32 largestFree)
+{
+	out->totalSize     = total;
+	out->usedSize      = __atomic_load_n(&s->used, __ATOMIC_RELAXED);
+	out->peakUsedSize  = __atomic_load_n(&s->peak, __ATOMIC_RELAXED);
+	out->freeBlocks    = freeBlocks;
+	out->largestFree   = largestFree;
+	out->fragmentation = freeSpace ? 1.0f - (float)largestFree / freeSpace : 0.0f;
+	out->allocCount    = __atomic_load_n(&s->allocs, __ATOMIC_RELAXED);
+	out->freeCount     = __atomic_load_n(&s->frees, __ATOMIC_RELAXED);
+}
@@ -1,21 +1,58 @@
+#include <string.h>
+
 extern "C"
 {
 	#include <3ds/types.h>
 	#include <3ds/allocator/linear.h>
+	#include <3ds/synchronization.h>
 	#include <3ds/util/rbtree.h>
+	#include "../internal.h"
 }
 
 #include "mem_pool.h"
 #include "addrmap.h"
+#include "alloc_stats.h"
 
 extern u32 __ctru_linear_heap;
 extern u32 __ctru_linear_heap_size;
 
 static MemPool sLinearPool;
+static LightLock sLinearLock = 1;
+static allocStatsState sLinearStats;
+
+// Small allocations are carved out of fixed-size runs. Each run is owned by
+// a single thread which allocates from it without taking the lock; any thread
+// may return a slot to it. The run header lives in the first slot.
+enum
+{
+	LINEAR_RUN_SHIFT   = 15,
+	LINEAR_RUN_SIZE    = 1 << LINEAR_RUN_SHIFT,
+	LINEAR_SLOT_MIN    = 7,  // 0x80, the linearAlloc alignment
+	LINEAR_SLOT_MAX    = 10, // 0x400
+	LINEAR_CLASS_COUNT = LINEAR_SLOT_MAX - LINEAR_SLOT_MIN + 1,
+	LINEAR_RUN_WORDS   = (LINEAR_RUN_SIZE >> LINEAR_SLOT_MIN) / 32,
+	LINEAR_MAP_WORDS   = (0x10000000 >> LINEAR_RUN_SHIFT) / 32, // Covers all of FCRAM
+};
+
+struct LinearRun
+{
+	u32 freeMap[LINEAR_RUN_WORDS]; // Set bits are free slots
+	u32 used;                      // Number of allocated slots
+	u32 shift;                     // Slot size
+	LinearRun** owner;             // Thread cache entry allocating from this run
+	LinearRun *prev, *next;        // Runs of the same size class
+	MemChunk chunk;
+};
+
+static_assert(sizeof(LinearRun) <= (1 << LINEAR_SLOT_MIN), "run header must fit in a slot");
+
+static LinearRun* sRuns[LINEAR_CLASS_COUNT];
+static u32 sRunMap[LINEAR_MAP_WORDS];
+static __thread LinearRun* tRunCache[LINEAR_CLASS_COUNT];
 
 static bool linearInit()
 {
-	auto blk = MemBlock::Create((u8*)__ctru_linear_heap, __ctru_linear_heap_size);
+	auto blk = sLinearPool.NewBlock((u8*)__ctru_linear_heap, __ctru_linear_heap_size);
 	if (blk)
 	{
 		sLinearPool.AddBlock(blk);
@@ -25,6 +62,171 @@ static bool linearInit()
 	return false;
 }
 
+static int runIndex(void* mem)
+{
+	u32 addr = (u32)mem;
+	if (addr < __ctru_linear_heap || addr - __ctru_linear_heap >= __ctru_linear_heap_size)
+		return -1;
+	u32 idx = (addr >> LINEAR_RUN_SHIFT) - (__ctru_linear_heap >> LINEAR_RUN_SHIFT);
+	return idx < LINEAR_MAP_WORDS*32 ? idx : -1;
+}
+
+static LinearRun* runForAddr(void* mem)
+{
+	int idx = runIndex(mem);
+	if (idx < 0 || !(__atomic_load_n(&sRunMap[idx/32], __ATOMIC_ACQUIRE) & (1U << (idx%32))))
+		return nullptr;
+	return (LinearRun*)((u32)mem &~ (LINEAR_RUN_SIZE-1));
+}
+
+static void* runClaim(LinearRun* r)
+{
+	// Only the owner clears bits, so a bit we see set stays set
+	for (int i = 0; i < LINEAR_RUN_WORDS; i ++)
+	{
+		u32 map = __atomic_load_n(&r->freeMap[i], __ATOMIC_ACQUIRE);
+		if (!map) continue;
+		int bit = __builtin_ctz(map);
+		__atomic_fetch_and(&r->freeMap[i], ~(1U << bit), __ATOMIC_ACQ_REL);
+		__atomic_add_fetch(&r->used, 1, __ATOMIC_ACQ_REL);
+		return (u8*)r + ((i*32 + bit) << r->shift);
+	}
+	return nullptr;
+}
+
+// Must be called with the lock held
+static void runRetire(LinearRun* r)
+{
+	int cls = r->shift - LINEAR_SLOT_MIN;
+	if (r->prev) r->prev->next = r->next;
+	else         sRuns[cls] = r->next;
+	if (r->next) r->next->prev = r->prev;
+
+	int idx = runIndex(r);
+	__atomic_fetch_and(&sRunMap[idx/32], ~(1U << (idx%32)), __ATOMIC_RELEASE);
+
+	MemChunk chunk = r->chunk;
+	sLinearPool.Deallocate(chunk);
+}
+
+// Must be called with the lock held
+static void runDetach(LinearRun** cache)
+{
+	auto r = *cache;
+	if (!r) return;
+	*cache = nullptr;
+	__atomic_store_n(&r->owner, nullptr, __ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&r->used, __ATOMIC_SEQ_CST))
+		runRetire(r);
+}
+
+// Must be called with the lock held
+static LinearRun* runRefill(int cls, LinearRun** cache)
+{
+	runDetach(cache);
+
+	u32 shift = LINEAR_SLOT_MIN + cls;
+	u32 slots = LINEAR_RUN_SIZE >> shift;
+
+	// Adopt a run left behind by another thread if it has room
+	for (auto r = sRuns[cls]; r; r = r->next)
+		if (!r->owner && __atomic_load_n(&r->used, __ATOMIC_ACQUIRE) < slots - 1)
+		{
+			__atomic_store_n(&r->owner, cache, __ATOMIC_SEQ_CST);
+			return *cache = r;
+		}
+
+	MemChunk chunk;
+	if (!sLinearPool.Allocate(chunk, LINEAR_RUN_SIZE, LINEAR_RUN_SHIFT))
+		return nullptr;
+
+	int idx = runIndex(chunk.addr);
+	if (idx < 0)
+	{
+		sLinearPool.Deallocate(chunk);
+		return nullptr;
+	}
+
+	// Slot 0 holds the header
+	auto r = (LinearRun*)chunk.addr;
+	for (u32 i = 0; i < LINEAR_RUN_WORDS; i ++)
+	{
+		u32 first = i*32, last = first + 32;
+		if (first < 1) first = 1;
+		if (last > slots) last = slots;
+		r->freeMap[i] = first < last ? (~0U >> (32 - (last - first))) << (first % 32) : 0;
+	}
+	r->used = 0;
+	r->shift = shift;
+	r->owner = cache;
+	r->prev = nullptr;
+	r->next = sRuns[cls];
+	if (r->next) r->next->prev = r;
+	r->chunk = chunk;
+	sRuns[cls] = r;
+
+	__atomic_fetch_or(&sRunMap[idx/32], 1U << (idx%32), __ATOMIC_RELEASE);
+	return *cache = r;
+}
+
+static bool runRelease(LinearRun* r, void* mem)
+{
+	u32 offset = (u8*)mem - (u8*)r;
+	u32 slot = offset >> r->shift;
+	if (!slot || (offset & ((1U << r->shift) - 1)))
+		return false; // Not a slot address
+
+	u32 bit = 1U << (slot%32);
+	if (__atomic_fetch_or(&r->freeMap[slot/32], bit, __ATOMIC_ACQ_REL) & bit)
+		return false; // Already free
+
+	// Give the run back to the pool once it is empty and no thread uses it
+	if (__atomic_sub_fetch(&r->used, 1, __ATOMIC_SEQ_CST) || __atomic_load_n(&r->owner, __ATOMIC_SEQ_CST))
+		return true;
+
+	LightLock_Lock(&sLinearLock);
+	if (runForAddr(mem) == r && !r->owner && !r->used)
+		runRetire(r);
+	LightLock_Unlock(&sLinearLock);
+	return true;
+}
+
+static void* linearSmallAlloc(size_t size, int shift)
+{
+	// Threads not created through threadCreate have no thread-local storage
+	if (getThreadVars()->magic != THREADVARS_MAGIC)
+		return nullptr;
+
+	int slot = size > (1U << LINEAR_SLOT_MIN) ? 32 - __builtin_clz(size - 1) : LINEAR_SLOT_MIN;
+	if (slot < shift)
+		slot = shift;
+
+	auto cache = &tRunCache[slot - LINEAR_SLOT_MIN];
+	void* mem = *cache ? runClaim(*cache) : nullptr;
+	if (!mem)
+	{
+		LightLock_Lock(&sLinearLock);
+		if (sLinearPool.Ready() || linearInit())
+		{
+			auto r = runRefill(slot - LINEAR_SLOT_MIN, cache);
+			if (r) mem = runClaim(r);
+		}
+		LightLock_Unlock(&sLinearLock);
+	}
+
+	if (mem)
+		allocStatsAlloc(&sLinearStats, mem, 1U << slot);
+	return mem;
+}
+
+extern "C" void __linear_thread_exit(void)
+{
+	LightLock_Lock(&sLinearLock);
+	for (auto& cache : tRunCache)
+		runDetach(&cache);
+	LightLock_Unlock(&sLinearLock);
+}
+
 void* linearMemAlign(size_t size, size_t alignment)
 {
 	// Convert alignment to shift
@@ -32,22 +234,34 @@ void* linearMemAlign(size_t size, size_t alignment)
 	if (shift < 0)
 		return nullptr;
 
+	// Serve small requests from this thread's runs
+	if (size <= (1U << LINEAR_SLOT_MAX) && shift <= LINEAR_SLOT_MAX)
+	{
+		void* mem = linearSmallAlloc(size, shift);
+		if (mem) return mem;
+	}
+
+	LightLock_Lock(&sLinearLock);
+
 	// Initialize the pool if it is not ready
 	if (!sLinearPool.Ready() && !linearInit())
+	{
+		LightLock_Unlock(&sLinearLock);
 		return nullptr;
+	}
 
 	// Allocate the chunk
 	MemChunk chunk;
 	if (!sLinearPool.Allocate(chunk, size, shift))
-		return nullptr;
-
-	auto node = newNode(chunk);
-	if (!node)
 	{
-		sLinearPool.Deallocate(chunk);
+		LightLock_Unlock(&sLinearLock);
 		return nullptr;
 	}
-	if (rbtree_insert(&sAddrMap, &node->node));
+
+	addBlock(chunk.block);
+
+	LightLock_Unlock(&sLinearLock);
+	allocStatsAlloc(&sLinearStats, chunk.addr, chunk.size);
 	return chunk.addr;
 }
 
@@ -58,29 +272,109 @@ void* linearAlloc(size_t size)
 
 void* linearRealloc(void* mem, size_t size)
 {
-	// TODO
-	return NULL;
+	if (!mem)
+		return linearAlloc(size);
+
+	size_t oldSize;
+	auto run = runForAddr(mem);
+	if (run)
+	{
+		// Slots can't be resized, but any size that fits is fine
+		oldSize = 1U << run->shift;
+		if (size <= oldSize)
+			return mem;
+	} else
+	{
+		LightLock_Lock(&sLinearLock);
+		auto b = getBlock(mem);
+		if (!b)
+		{
+			LightLock_Unlock(&sLinearLock);
+			return nullptr;
+		}
+
+		// Try to resize the chunk in place
+		oldSize = b->size;
+		bool resized = sLinearPool.Reallocate(b, size);
+		u32 newSize = b->size;
+		LightLock_Unlock(&sLinearLock);
+		if (resized)
+		{
+			allocStatsResize(&sLinearStats, mem, oldSize, newSize);
+			return mem;
+		}
+	}
+
+	// Otherwise move it to a new chunk
+	void* newMem = linearAlloc(size);
+	if (!newMem) return nullptr;
+
+	memcpy(newMem, mem, oldSize < size ? oldSize : size);
+	linearFree(mem);
+	return newMem;
 }
 
 size_t linearGetSize(void* mem)
 {
-	auto node = getNode(mem);
-	return node ? node->chunk.size : 0;
+	auto run = runForAddr(mem);
+	if (run)
+		return 1U << run->shift;
+
+	LightLock_Lock(&sLinearLock);
+	auto b = getBlock(mem);
+	size_t size = b ? b->size : 0;
+	LightLock_Unlock(&sLinearLock);
+	return size;
 }
 
 void linearFree(void* mem)
 {
-	auto node = getNode(mem);
-	if (!node) return;
+	auto run = runForAddr(mem);
+	if (run)
+	{
+		u32 size = 1U << run->shift;
+		if (runRelease(run, mem))
+			allocStatsFree(&sLinearStats, mem, size);
+		return;
+	}
 
-	// Free the chunk
-	sLinearPool.Deallocate(node->chunk);
+	LightLock_Lock(&sLinearLock);
+	auto b = getBlock(mem);
+	u32 size = 0;
+	if (b)
+	{
+		size = b->size;
+		delBlock(b);
+		sLinearPool.Deallocate(b);
+	}
+	LightLock_Unlock(&sLinearLock);
 
-	// Free the node
-	delNode(node);
+	if (b)
+		allocStatsFree(&sLinearStats, mem, size);
 }
 
 u32 linearSpaceFree()
 {
-	return sLinearPool.GetFreeSpace();
+	LightLock_Lock(&sLinearLock);
+	u32 space = sLinearPool.GetFreeSpace();
+	LightLock_Unlock(&sLinearLock);
+	return space;
+}
+
+void linearGetStats(allocatorStats* stats)
+{
+	LightLock_Lock(&sLinearLock);
+	if (!sLinearPool.Ready())
+		linearInit();
+	u32 freeSpace = sLinearPool.GetFreeSpace();
+	u32 freeBlocks = sLinearPool.GetFreeBlocks();
+	u32 largestFree = sLinearPool.GetLargestFree();
+	LightLock_Unlock(&sLinearLock);
+
+	allocStatsFill(&sLinearStats, stats, __ctru_linear_heap_size, freeSpace, freeBlocks, largestFree);
+}
+
+void linearSetHook(allocatorHook hook, void* user)
+{
+	allocStatsSetHook(&sLinearStats, hook, user);
 }
@@ -1,8 +1,10 @@
 #include <3ds/allocator/mappable.h>
 #include <3ds/svc.h>
 #include <3ds/result.h>
+#include "alloc_stats.h"
 
 static u32 minAddr, maxAddr, currentAddr;
+static allocStatsState mappableStats;
 
 void mappableInit(u32 addrMin, u32 addrMax)
 {
@@ -50,10 +52,57 @@ void* mappableAlloc(size_t size)
 	}
 
 	currentAddr = addr + size >= maxAddr ? minAddr : addr + size;
+
+	__atomic_add_fetch(&mappableStats.allocs, 1, __ATOMIC_RELAXED);
+	allocStatsNotify(&mappableStats, ALLOCATOR_EVENT_ALLOC, (void *)addr, size);
 	return (void *)addr;
 }
 
 void mappableFree(void* mem)
 {
-	(void)mem;
+	// Nothing to release, but keep the counters balanced
+	if (!mem) return;
+	__atomic_add_fetch(&mappableStats.frees, 1, __ATOMIC_RELAXED);
+	allocStatsNotify(&mappableStats, ALLOCATOR_EVENT_FREE, mem, 0);
+}
+
+void mappableGetStats(allocatorStats* stats)
+{
+	MemInfo info;
+	PageInfo pgInfo;
+	u32 freeSpace = 0, freeBlocks = 0, largestFree = 0;
+
+	// The allocator doesn't track its areas, so report what is actually mapped
+	u32 addr = minAddr;
+	while (addr < maxAddr)
+	{
+		if (R_FAILED(svcQueryMemory(&info, &pgInfo, addr)) || info.base_addr + info.size <= addr)
+			break;
+
+		u32 end = info.base_addr + info.size;
+		if (end > maxAddr)
+			end = maxAddr;
+
+		if (info.state == MEMSTATE_FREE)
+		{
+			u32 sz = end - addr;
+			freeSpace += sz;
+			freeBlocks++;
+			if (sz > largestFree)
+				largestFree = sz;
+		}
+
+		addr = end;
+	}
+
+	u32 used = maxAddr - minAddr - freeSpace;
+	mappableStats.used = used;
+	if (used > mappableStats.peak)
+		mappableStats.peak = used;
+	allocStatsFill(&mappableStats, stats, maxAddr - minAddr, freeSpace, freeBlocks, largestFree);
+}
+
+void mappableSetHook(allocatorHook hook, void* user)
+{
+	allocStatsSetHook(&mappableStats, hook, user);
 }
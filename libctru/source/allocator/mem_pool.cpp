@@ -1,33 +1,79 @@
 #include "mem_pool.h"
 
-/*
-// This method is currently unused
-void MemPool::CoalesceLeft(MemBlock* b)
+static inline u32 alignWaste(MemBlock* b, u32 alignMask)
+{
+	u32 begWaste = (u32)b->base & alignMask;
+	if (begWaste > 0) begWaste = alignMask + 1 - begWaste;
+	return begWaste;
+}
+
+static inline bool blockFits(MemBlock* b, u32 size, u32 alignMask)
 {
-	auto curPtr = b->base;
-	for (auto p = b->prev; p; p = p->prev)
+	u32 begWaste = alignWaste(b, alignMask);
+	return begWaste <= b->size && b->size - begWaste >= size;
+}
+
+MemBlock* MemPool::FindFree(u32 size)
+{
+	// Round the size up to the next list boundary, so that any block
+	// in the list we find is large enough
+	if (size >= MEMPOOL_SL_COUNT)
 	{
-		if ((p->base + p->size) != curPtr) break;
-		curPtr = p->base;
-		p->size += b->size;
-		DelBlock(b);
-		b = p;
+		u32 round = (1U << (31 - __builtin_clz(size) - MEMPOOL_SL_SHIFT)) - 1;
+		if (size > UINT32_MAX - round)
+			return nullptr;
+		size += round;
 	}
+
+	int fl, sl;
+	Mapping(size, fl, sl);
+
+	u32 slMap = slBitmap[fl] & (~0U << sl);
+	if (!slMap)
+	{
+		// Move on to the next non-empty first level list
+		u32 flMap = fl + 1 < MEMPOOL_FL_COUNT ? flBitmap & (~0U << (fl + 1)) : 0;
+		if (!flMap)
+			return nullptr;
+
+		fl = __builtin_ctz(flMap);
+		slMap = slBitmap[fl];
+	}
+
+	return freeLists[fl][__builtin_ctz(slMap)];
 }
-*/
 
-void MemPool::CoalesceRight(MemBlock* b)
+MemBlock* MemPool::NewBlock(u8* base, u32 size)
 {
-	auto curPtr = b->base + b->size;
-	auto next = b->next;
-	for (auto n = next; n; n = next)
+	if (!spareBlocks)
 	{
-		next = n->next;
-		if (n->base != curPtr) break;
-		b->size += n->size;
-		curPtr += n->size;
-		DelBlock(n);
+		auto s = (MemBlockSlab*)malloc(sizeof(MemBlockSlab));
+		if (!s) return nullptr;
+		s->next = slabs;
+		slabs = s;
+		for (auto& b : s->blocks)
+			FreeBlock(&b);
 	}
+
+	auto b = spareBlocks;
+	spareBlocks = b->next;
+	b->prev = nullptr;
+	b->next = nullptr;
+	b->prevFree = nullptr;
+	b->nextFree = nullptr;
+	b->base = base;
+	b->size = size;
+	b->free = true;
+	return b;
+}
+
+MemBlock* MemPool::Split(MemBlock* b, u32 offset)
+{
+	auto n = NewBlock(b->base + offset, b->size - offset);
+	if (!n) return nullptr;
+	b->size = offset;
+	InsertAfter(b, n);
+	return n;
 }
 
 bool MemPool::Allocate(MemChunk& chunk, u32 size, int align)
@@ -42,6 +88,10 @@ bool MemPool::Allocate(MemChunk& chunk, u32 size, int align)
 
 	u32 alignMask = (1 << align) - 1;
 
+	// Zero-sized allocations still need a unique address
+	if(size == 0)
+		size = alignMask + 1;
+
 	// Check if size doesn't fit neatly in alignment
 	if(size & alignMask)
 	{
@@ -53,87 +103,137 @@ bool MemPool::Allocate(MemChunk& chunk, u32 size, int align)
 		size = (size + alignMask) &~ alignMask;
 	}
 
-	// Find the first suitable block
-	for (auto b = first; b; b = b->next)
+	// Find a block that fits regardless of its alignment
+	MemBlock* b = nullptr;
+	if (size <= UINT32_MAX - alignMask)
+		b = FindFree(size + alignMask);
+
+	if (!b)
 	{
-		auto addr = b->base;
-		u32 begWaste = (u32)addr & alignMask;
-		if (begWaste > 0) begWaste = alignMask + 1 - begWaste;
-		if (begWaste > b->size) continue;
-		addr += begWaste;
-		u32 bSize = b->size - begWaste;
-		if (bSize < size) continue;
-
-		// Found space!
-		chunk.addr = addr;
-		chunk.size = size;
-
-		// Resize the block
-		if (!begWaste)
+		// Fall back to searching the lists that may contain a block that
+		// fits once aligned
+		int fl0, sl0;
+		Mapping(size, fl0, sl0);
+		for (int fl = fl0; !b && fl < MEMPOOL_FL_COUNT; fl++)
 		{
-			b->base += size;
-			b->size -= size;
-			if (!b->size)
-				DelBlock(b);
-		} else
-		{
-			auto nAddr = addr + size;
-			auto nSize = bSize - size;
-			b->size = begWaste;
-			if (nSize)
-			{
-				// We need to add the tail chunk that wasn't used to the list
-				auto n = MemBlock::Create(nAddr, nSize);
-				if (n) InsertAfter(b, n);
-				else   chunk.size += nSize; // we have no choice but to waste the space.
-			}
+			if (!(flBitmap & (1U << fl))) continue;
+			for (int sl = fl == fl0 ? sl0 : 0; !b && sl < MEMPOOL_SL_COUNT; sl++)
+				for (auto p = freeLists[fl][sl]; !b && p; p = p->nextFree)
+					if (blockFits(p, size, alignMask))
+						b = p;
 		}
-		return true;
+
+		if (!b)
+			return false;
+	}
+
+	// Found space!
+	RemoveFree(b);
+
+	u32 begWaste = alignWaste(b, alignMask);
+	if (begWaste)
+	{
+		// Return the unaligned head to the pool
+		auto n = Split(b, begWaste);
+		InsertFree(b);
+		if (!n) return false;
+		b = n;
+	}
+
+	if (b->size > size)
+	{
+		// Return the unused tail to the pool; if we can't, we have no
+		// choice but to waste the space
+		auto n = Split(b, size);
+		if (n) InsertFree(n);
 	}
 
-	return false;
+	b->free = false;
+	freeSpace -= b->size;
+
+	chunk.addr = b->base;
+	chunk.size = b->size;
+	chunk.block = b;
+	return true;
 }
 
-void MemPool::Deallocate(const MemChunk& chunk)
+bool MemPool::Reallocate(MemBlock* b, u32 size)
 {
-	u8*  cAddr = chunk.addr;
-	auto cSize = chunk.size;
-	bool done = false;
+	u32 alignMask = (1 << alignmentToShift(0)) - 1;
+
+	// Keep block boundaries at the minimum alignment
+	if (size > UINT32_MAX - alignMask)
+		return false;
+	size = (size + alignMask) &~ alignMask;
+	if (!size)
+		size = alignMask + 1;
 
-	// Try to merge the chunk somewhere into the list
-	for (auto b = first; !done && b; b = b->next)
+	auto next = b->next;
+	bool nextFree = next && next->free && (b->base + b->size) == next->base;
+
+	if (size < b->size)
 	{
-		auto addr = b->base;
-		if (addr > cAddr)
+		// Return the tail to the pool, merging it with the next block if free
+		u32 tail = b->size - size;
+		if (nextFree)
 		{
-			if ((cAddr + cSize) == addr)
-			{
-				// Merge the chunk to the left of the block
-				b->base = cAddr;
-				b->size += cSize;
-			} else
-			{
-				// We need to insert a new block
-				auto c = MemBlock::Create(cAddr, cSize);
-				if (c) InsertBefore(b, c);
-			}
-			done = true;
-		} else if ((b->base + b->size) == cAddr)
+			RemoveFree(next);
+			next->base -= tail;
+			next->size += tail;
+			InsertFree(next);
+		} else
 		{
-			// Coalesce to the right
-			b->size += cSize;
-			CoalesceRight(b);
-			done = true;
+			auto n = Split(b, size);
+			if (!n) return true; // keep the tail rather than fail
+			InsertFree(n);
 		}
+		b->size = size;
+		freeSpace += tail;
+	} else if (size > b->size)
+	{
+		// Grow into the next block if it is free and large enough
+		u32 grow = size - b->size;
+		if (!nextFree || next->size < grow)
+			return false;
+
+		RemoveFree(next);
+		if (next->size > grow)
+		{
+			next->base += grow;
+			next->size -= grow;
+			InsertFree(next);
+		} else
+			DelBlock(next);
+		b->size = size;
+		freeSpace -= grow;
 	}
 
-	if (!done)
+	return true;
+}
+
+void MemPool::Deallocate(MemBlock* b)
+{
+	freeSpace += b->size;
+
+	// Coalesce with the physically adjacent free blocks
+	auto prev = b->prev;
+	if (prev && prev->free && (prev->base + prev->size) == b->base)
 	{
-		// Either the list is empty or the chunk address is past the end
-		// address of the last block -- let's add a new block at the end
-		auto b = MemBlock::Create(cAddr, cSize);
-		if (b) AddBlock(b);
+		RemoveFree(prev);
+		prev->size += b->size;
+		DelBlock(b);
+		b = prev;
 	}
+
+	auto next = b->next;
+	if (next && next->free && (b->base + b->size) == next->base)
+	{
+		RemoveFree(next);
+		b->size += next->size;
+		DelBlock(next);
+	}
+
+	InsertFree(b);
 }
 
 /*
@@ -147,8 +247,20 @@ void MemPool::Dump(const char* title)
 
 u32 MemPool::GetFreeSpace()
 {
-	u32 acc = 0;
-	for (auto b = first; b; b = b->next)
-		acc += b->size;
-	return acc;
+	return freeSpace;
+}
+
+u32 MemPool::GetLargestFree()
+{
+	if (!flBitmap)
+		return 0;
+
+	// Only the highest non-empty list can hold the largest block
+	int fl = 31 - __builtin_clz(flBitmap);
+	int sl = 31 - __builtin_clz(slBitmap[fl]);
+	u32 largest = 0;
+	for (auto b = freeLists[fl][sl]; b; b = b->nextFree)
+		if (b->size > largest)
+			largest = b->size;
+	return largest;
 }
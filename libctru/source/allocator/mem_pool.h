@@ -1,5 +1,6 @@
 #pragma once
 #include <3ds/types.h>
+#include <3ds/util/rbtree.h>
 #include <stdlib.h>
 
 static inline int alignmentToShift(size_t alignment)
@@ -11,42 +12,121 @@ static inline int alignmentToShift(size_t alignment)
 	return __builtin_ffs(alignment)-1;
 }
 
+struct MemBlock;
+
 struct MemChunk
 {
 	u8* addr;
 	u32 size;
+	MemBlock* block;
 };
 
 struct MemBlock
 {
-	MemBlock *prev, *next;
+	MemBlock *prev, *next;         // Physically adjacent blocks
+	MemBlock *prevFree, *nextFree; // Blocks in the same free list
+	rbtree_node node;              // Address map entry while allocated
 	u8* base;
 	u32 size;
+	bool free;
+};
 
-	static MemBlock* Create(u8* base, u32 size)
-	{
-		auto b = (MemBlock*)malloc(sizeof(MemBlock));
-		if (!b) return nullptr;
-		b->prev = nullptr;
-		b->next = nullptr;
-		b->base = base;
-		b->size = size;
-		return b;
-	}
+// Block descriptors are carved out of slabs owned by the pool, so that
+// splitting a block doesn't need a trip to the heap
+enum { MEMPOOL_SLAB_COUNT = 32 };
+
+struct MemBlockSlab
+{
+	MemBlockSlab* next;
+	MemBlock blocks[MEMPOOL_SLAB_COUNT];
+};
+
+// Free blocks are binned TLSF-style: the first level is the power of two
+// below the block size, and the second level splits that range linearly.
+enum
+{
+	MEMPOOL_SL_SHIFT = 4,
+	MEMPOOL_SL_COUNT = 1 << MEMPOOL_SL_SHIFT,
+	MEMPOOL_FL_COUNT = 32 - MEMPOOL_SL_SHIFT + 1,
 };
 
 struct MemPool
 {
-	MemBlock *first, *last;
+	MemBlock *first, *last; // All blocks, in address order
+	u32 flBitmap;
+	u16 slBitmap[MEMPOOL_FL_COUNT];
+	MemBlock* freeLists[MEMPOOL_FL_COUNT][MEMPOOL_SL_COUNT];
+	MemBlockSlab* slabs;
+	MemBlock* spareBlocks; // Unused descriptors, linked through next
+	u32 freeSpace;
+	u32 freeBlocks;
 
 	bool Ready() { return first != nullptr; }
 
+	static void Mapping(u32 size, int& fl, int& sl)
+	{
+		if (size < MEMPOOL_SL_COUNT)
+		{
+			fl = 0;
+			sl = size;
+		} else
+		{
+			int msb = 31 - __builtin_clz(size);
+			fl = msb - MEMPOOL_SL_SHIFT + 1;
+			sl = (size >> (msb - MEMPOOL_SL_SHIFT)) ^ MEMPOOL_SL_COUNT;
+		}
+	}
+
+	void InsertFree(MemBlock* b)
+	{
+		int fl, sl;
+		Mapping(b->size, fl, sl);
+		auto& head = freeLists[fl][sl];
+		b->free = true;
+		b->prevFree = nullptr;
+		b->nextFree = head;
+		if (head) head->prevFree = b;
+		head = b;
+		flBitmap |= 1U << fl;
+		slBitmap[fl] |= 1U << sl;
+		freeBlocks++;
+	}
+
+	void RemoveFree(MemBlock* b)
+	{
+		int fl, sl;
+		Mapping(b->size, fl, sl);
+		auto& head = freeLists[fl][sl];
+		if (b->prevFree) b->prevFree->nextFree = b->nextFree;
+		else             head = b->nextFree;
+		if (b->nextFree) b->nextFree->prevFree = b->prevFree;
+		b->prevFree = nullptr;
+		b->nextFree = nullptr;
+		freeBlocks--;
+		if (!head)
+		{
+			slBitmap[fl] &= ~(1U << sl);
+			if (!slBitmap[fl])
+				flBitmap &= ~(1U << fl);
+		}
+	}
+
+	MemBlock* NewBlock(u8* base, u32 size);
+
+	void FreeBlock(MemBlock* b)
+	{
+		b->next = spareBlocks;
+		spareBlocks = b;
+	}
+
 	void AddBlock(MemBlock* blk)
 	{
 		blk->prev = last;
 		if (last) last->next = blk;
 		if (!first) first = blk;
 		last = blk;
+		freeSpace += blk->size;
+		InsertFree(blk);
 	}
 
 	void DelBlock(MemBlock* b)
@@ -55,16 +135,7 @@ struct MemPool
 		auto next = b->next, &nPrev = next ? next->prev : last;
 		pNext = next;
 		nPrev = prev;
-		free(b);
-	}
-
-	void InsertBefore(MemBlock* b, MemBlock* p)
-	{
-		auto prev = b->prev, &pNext = prev ? prev->next : first;
-		b->prev = p;
-		p->next = b;
-		p->prev = prev;
-		pNext = p;
+		FreeBlock(b);
 	}
 
 	void InsertAfter(MemBlock* b, MemBlock* n)
@@ -76,24 +147,38 @@ struct MemPool
 		nPrev = n;
 	}
 
-	//void CoalesceLeft(MemBlock* b);
-	void CoalesceRight(MemBlock* b);
+	MemBlock* FindFree(u32 size);
+	MemBlock* Split(MemBlock* b, u32 offset);
 
 	bool Allocate(MemChunk& chunk, u32 size, int align);
-	void Deallocate(const MemChunk& chunk);
+	bool Reallocate(MemBlock* b, u32 size);
+	void Deallocate(MemBlock* b);
+	void Deallocate(const MemChunk& chunk) { Deallocate(chunk.block); }
 
 	void Destroy()
 	{
-		MemBlock* next = nullptr;
-		for (auto b = first; b; b = next)
+		MemBlockSlab* next = nullptr;
+		for (auto s = slabs; s; s = next)
 		{
-			next = b->next;
-			free(b);
+			next = s->next;
+			free(s);
 		}
+		slabs = nullptr;
+		spareBlocks = nullptr;
 		first = nullptr;
 		last = nullptr;
+		flBitmap = 0;
+		for (auto& map : slBitmap)
+			map = 0;
+		for (auto& lists : freeLists)
+			for (auto& head : lists)
+				head = nullptr;
+		freeSpace = 0;
+		freeBlocks = 0;
 	}
 
 	//void Dump(const char* title);
 	u32 GetFreeSpace();
+	u32 GetFreeBlocks() { return freeBlocks; }
+	u32 GetLargestFree();
 };
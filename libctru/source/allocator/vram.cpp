@@ -3,27 +3,31 @@ extern "C"
 	#include <3ds/types.h>
 	#include <3ds/os.h>
 	#include <3ds/allocator/vram.h>
+	#include <3ds/synchronization.h>
 	#include <3ds/util/rbtree.h>
 }
 
 #include "mem_pool.h"
 #include "addrmap.h"
+#include "alloc_stats.h"
 
 static MemPool sVramPoolA, sVramPoolB;
+static LightLock sVramLock = 1;
+static allocStatsState sVramStats;
 
 static bool vramInit()
 {
 	if (sVramPoolA.Ready() || sVramPoolB.Ready())
 		return true;
 
-	auto blkA = MemBlock::Create((u8*)OS_VRAM_VADDR,                  OS_VRAM_SIZE/2);
+	auto blkA = sVramPoolA.NewBlock((u8*)OS_VRAM_VADDR,                  OS_VRAM_SIZE/2);
 	if (!blkA)
 		return false;
 
-	auto blkB = MemBlock::Create((u8*)OS_VRAM_VADDR + OS_VRAM_SIZE/2, OS_VRAM_SIZE/2);
+	auto blkB = sVramPoolB.NewBlock((u8*)OS_VRAM_VADDR + OS_VRAM_SIZE/2, OS_VRAM_SIZE/2);
 	if (!blkB)
 	{
-		free(blkA);
+		sVramPoolA.Destroy();
 		return false;
 	}
 
@@ -67,9 +71,14 @@ void* vramMemAlignAt(size_t size, size_t alignment, vramAllocPos pos)
 	if (shift < 0)
 		return nullptr;
 
+	LightLock_Lock(&sVramLock);
+
 	// Initialize the allocator if it is not ready
 	if (!vramInit())
+	{
+		LightLock_Unlock(&sVramLock);
 		return nullptr;
+	}
 
 	// Allocate the chunk
 	MemChunk chunk;
@@ -98,15 +107,15 @@ void* vramMemAlignAt(size_t size, size_t alignment, vramAllocPos pos)
 	}
 
 	if (!didAlloc)
-		return nullptr;
-
-	auto node = newNode(chunk);
-	if (!node)
 	{
-		vramPoolForAddr(chunk.addr)->Deallocate(chunk);
+		LightLock_Unlock(&sVramLock);
 		return nullptr;
 	}
-	if (rbtree_insert(&sAddrMap, &node->node));
+
+	addBlock(chunk.block);
+
+	LightLock_Unlock(&sVramLock);
+	allocStatsAlloc(&sVramStats, chunk.addr, chunk.size);
 	return chunk.addr;
 }
 
@@ -118,23 +127,51 @@ void* vramRealloc(void* mem, size_t size)
 
 size_t vramGetSize(void* mem)
 {
-	auto node = getNode(mem);
-	return node ? node->chunk.size : 0;
+	LightLock_Lock(&sVramLock);
+	auto b = getBlock(mem);
+	size_t size = b ? b->size : 0;
+	LightLock_Unlock(&sVramLock);
+	return size;
 }
 
 void vramFree(void* mem)
 {
-	auto node = getNode(mem);
-	if (!node) return;
-
-	// Free the chunk
-	vramPoolForAddr(mem)->Deallocate(node->chunk);
+	LightLock_Lock(&sVramLock);
+	auto b = getBlock(mem);
+	u32 size = 0;
+	if (b)
+	{
+		size = b->size;
+		delBlock(b);
+		vramPoolForAddr(mem)->Deallocate(b);
+	}
+	LightLock_Unlock(&sVramLock);
 
-	// Free the node
-	delNode(node);
+	if (b)
+		allocStatsFree(&sVramStats, mem, size);
 }
 
 u32 vramSpaceFree()
 {
-	return sVramPoolA.GetFreeSpace() + sVramPoolB.GetFreeSpace();
+	LightLock_Lock(&sVramLock);
+	u32 space = sVramPoolA.GetFreeSpace() + sVramPoolB.GetFreeSpace();
+	LightLock_Unlock(&sVramLock);
+	return space;
+}
+
+void vramGetStats(allocatorStats* stats)
+{
+	LightLock_Lock(&sVramLock);
+	vramInit();
+	u32 freeSpace = sVramPoolA.GetFreeSpace() + sVramPoolB.GetFreeSpace();
+	u32 freeBlocks = sVramPoolA.GetFreeBlocks() + sVramPoolB.GetFreeBlocks();
+	u32 largestA = sVramPoolA.GetLargestFree(), largestB = sVramPoolB.GetLargestFree();
+	LightLock_Unlock(&sVramLock);
+
+	allocStatsFill(&sVramStats, stats, OS_VRAM_SIZE, freeSpace, freeBlocks, largestA > largestB ? largestA : largestB);
+}
+
+void vramSetHook(allocatorHook hook, void* user)
+{
+	allocStatsSetHook(&sVramStats, hook, user);
 }
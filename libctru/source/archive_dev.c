@@ -56,9 +56,14 @@ static int       sdmc_statvfs(struct _reent *r, const char *path, struct statvfs
 /*! Open file struct */
 typedef struct
 {
-  Handle fd;     /*! CTRU handle */
-  int    flags;  /*! Flags used in open(2) */
-  u64    offset; /*! Current file offset */
+  Handle fd;          /*! CTRU handle */
+  int    flags;       /*! Flags used in open(2) */
+  u64    offset;      /*! Current file offset */
+  u8     *wbuf;       /*! Write-back buffer, or NULL if writes are not buffered */
+  u32    wbuf_size;   /*! Capacity of the write-back buffer */
+  u32    wbuf_len;    /*! Number of bytes pending in the write-back buffer */
+  u64    wbuf_offset; /*! File offset of the pending bytes */
+  u64    size;        /*! File size, including pending bytes (only kept while buffering) */
 } archive_file_t;
 
 /*! archive devoptab */
@@ -581,9 +586,12 @@ archive_open(struct _reent *r,
       }
     }
 
-    file->fd     = fd;
-    file->flags  = (flags & (O_ACCMODE|O_APPEND|O_SYNC));
-    file->offset = 0;
+    file->fd        = fd;
+    file->flags     = (flags & (O_ACCMODE|O_APPEND|O_SYNC));
+    file->offset    = 0;
+    file->wbuf      = NULL;
+    file->wbuf_size = 0;
+    file->wbuf_len  = 0;
     return 0;
   }
 
@@ -591,6 +599,109 @@ archive_open(struct _reent *r,
   return -1;
 }
 
+/*! Forget about pending bytes of a file's write-back buffer that didn't reach the file
+ *
+ *  @param[in,out] file    Pointer to archive_file_t
+ *  @param[in]     len     Number of bytes that were pending
+ *  @param[in]     written Number of them that were written out
+ */
+static void
+archive_drop_pending(archive_file_t *file,
+                     u32            len,
+                     u32            written)
+{
+  Result rc;
+  u64    end = file->wbuf_offset + written;
+
+  /* the offset only moved past the dropped bytes if nothing happened since */
+  if(file->offset == file->wbuf_offset + len)
+    file->offset = end;
+
+  /* the tracked size may count dropped bytes, so ask for the real one */
+  rc = FSFILE_GetSize(file->fd, &file->size);
+  if(R_FAILED(rc) && file->size > end)
+    file->size = end;
+}
+
+/*! Write out the pending bytes of a file's write-back buffer
+ *
+ *  @param[in,out] r    newlib reentrancy struct
+ *  @param[in,out] file Pointer to archive_file_t
+ *
+ *  @returns 0 for success
+ *  @returns -1 for error
+ */
+static int
+archive_flush(struct _reent  *r,
+              archive_file_t *file)
+{
+  Result rc;
+  u32    bytes;
+  u32    len = file->wbuf_len;
+
+  if(len == 0)
+    return 0;
+
+  /* the pending bytes are dropped on failure, like an unbuffered write that failed */
+  file->wbuf_len = 0;
+  rc = FSFILE_Write(file->fd, &bytes, file->wbuf_offset, file->wbuf, len, 0);
+  if(R_FAILED(rc))
+  {
+    r->_errno = archive_translate_error(rc);
+    archive_drop_pending(file, len, 0);
+    return -1;
+  }
+
+  if(bytes != len)
+  {
+    r->_errno = EIO;
+    archive_drop_pending(file, len, bytes);
+    return -1;
+  }
+
+  return 0;
+}
+
+Result archiveSetFileBuffering(int fd, size_t size)
+{
+  Result rc = 0;
+  __handle *handle = __get_handle(fd);
+  if(handle == NULL || devoptab_list[handle->device]->write_r != archive_write)
+    return MAKERESULT(RL_USAGE, RS_INVALIDARG, RM_APPLICATION, RD_INVALID_HANDLE);
+
+  archive_file_t *file = (archive_file_t*)handle->fileStruct;
+
+  /* O_SYNC asks for every write to reach the media */
+  if(size && ((file->flags & O_ACCMODE) == O_RDONLY || (file->flags & O_SYNC)))
+    return MAKERESULT(RL_USAGE, RS_NOTSUPPORTED, RM_APPLICATION, RD_NOT_IMPLEMENTED);
+
+  /* write out whatever the old buffer holds */
+  if(file->wbuf_len)
+  {
+    struct _reent r = { 0 };
+    if(archive_flush(&r, file) != 0)
+      rc = MAKERESULT(RL_PERMANENT, RS_INTERNAL, RM_APPLICATION, RD_NO_DATA);
+  }
+
+  free(file->wbuf);
+  file->wbuf      = NULL;
+  file->wbuf_size = 0;
+  if(size == 0 || R_FAILED(rc))
+    return rc;
+
+  /* the file size is tracked locally from here on */
+  rc = FSFILE_GetSize(file->fd, &file->size);
+  if(R_FAILED(rc))
+    return rc;
+
+  file->wbuf = (u8*)malloc(size);
+  if(file->wbuf == NULL)
+    return MAKERESULT(RL_FATAL, RS_OUTOFRESOURCE, RM_APPLICATION, RD_OUT_OF_MEMORY);
+
+  file->wbuf_size = size;
+  return 0;
+}
+
 /*! Close an open file
  *
  *  @param[in,out] r  newlib reentrancy struct
@@ -608,14 +719,108 @@ archive_close(struct _reent *r,
   /* get pointer to our data */
   archive_file_t *file = (archive_file_t*)fd;
 
+  /* write out pending data, but close the file regardless */
+  int flushed = archive_flush(r, file);
+  free(file->wbuf);
+  file->wbuf = NULL;
+
   rc = FSFILE_Close(file->fd);
   if(R_SUCCEEDED(rc))
-    return 0;
+    return flushed;
 
   r->_errno = archive_translate_error(rc);
   return -1;
 }
 
+/*! Write to an open file through its write-back buffer
+ *
+ *  @param[in,out] r    newlib reentrancy struct
+ *  @param[in,out] file Pointer to archive_file_t
+ *  @param[in]     ptr  Pointer to data to write
+ *  @param[in]     len  Length of data to write
+ *
+ *  @returns number of bytes written
+ *  @returns -1 for error
+ */
+static ssize_t
+archive_write_buffered(struct _reent  *r,
+                       archive_file_t *file,
+                       const char     *ptr,
+                       size_t         len)
+{
+  Result      rc;
+  u32         bytes;
+  size_t      done = 0;
+  u64         start;
+  bool        short_write = false;
+
+  /* append means write from the end of the file, which we keep track of */
+  if(file->flags & O_APPEND)
+    file->offset = file->size;
+  start = file->offset;
+
+  /* only contiguous writes can be merged */
+  if(file->wbuf_len && file->offset != file->wbuf_offset + file->wbuf_len)
+  {
+    if(archive_flush(r, file) != 0)
+      return -1;
+  }
+
+  while(done < len)
+  {
+    if(!file->wbuf_len)
+      file->wbuf_offset = file->offset;
+
+    /* the buffer is flushed at multiples of its size, so that all
+     * flushes but the first are aligned */
+    u32 limit = file->wbuf_size - (u32)(file->wbuf_offset % file->wbuf_size);
+    size_t left = len - done;
+
+    if(!file->wbuf_len && limit == file->wbuf_size && left >= file->wbuf_size)
+    {
+      /* whole aligned chunks don't need to go through the buffer */
+      u32 chunk = (left / file->wbuf_size) * file->wbuf_size;
+      rc = FSFILE_Write(file->fd, &bytes, file->offset, ptr + done, chunk, 0);
+      if(R_FAILED(rc))
+      {
+        if(done)
+          break;
+        r->_errno = archive_translate_error(rc);
+        return -1;
+      }
+
+      /* stop at a short write, like the unbuffered path */
+      short_write = bytes < chunk;
+    }
+    else
+    {
+      bytes = limit - file->wbuf_len;
+      if(bytes > left)
+        bytes = left;
+      memcpy(file->wbuf + file->wbuf_len, ptr + done, bytes);
+      file->wbuf_len += bytes;
+    }
+
+    done         += bytes;
+    file->offset += bytes;
+    if(file->offset > file->size)
+      file->size = file->offset;
+
+    if(file->wbuf_len == limit && archive_flush(r, file) != 0)
+    {
+      /* the offset was moved back to the end of what reached the file,
+       * report the part of this write that made it */
+      if(file->offset <= start)
+        return -1;
+      return file->offset - start;
+    }
+    if(bytes == 0 || short_write)
+      break;
+  }
+
+  return done;
+}
+
 /*! Write to an open file
  *
  *  @param[in,out] r   newlib reentrancy struct
@@ -646,6 +851,9 @@ archive_write(struct _reent *r,
     return -1;
   }
 
+  if(file->wbuf)
+    return archive_write_buffered(r, file, ptr, len);
+
   /* check if this is synchronous or not */
   if(file->flags & O_SYNC)
     sync = FS_WRITE_FLUSH | FS_WRITE_UPDATE_TIME;
@@ -703,6 +911,10 @@ archive_read(struct _reent *r,
     return -1;
   }
 
+  /* make pending writes visible */
+  if(archive_flush(r, file) != 0)
+    return -1;
+
   /* read the data */
   rc = FSFILE_Read(file->fd, &bytes, file->offset, (u32*)ptr, (u32)len);
   if(R_SUCCEEDED(rc))
@@ -753,6 +965,11 @@ archive_seek(struct _reent *r,
 
     /* set position relative to the end of the file */
     case SEEK_END:
+      if(file->wbuf)
+      {
+        offset = file->size;
+        break;
+      }
       rc = FSFILE_GetSize(file->fd, &offset);
       if(R_FAILED(rc))
       {
@@ -798,6 +1015,10 @@ archive_fstat(struct _reent *r,
   u64         size;
   archive_file_t *file = (archive_file_t*)fd;
 
+  /* make pending writes visible */
+  if(archive_flush(r, file) != 0)
+    return -1;
+
   rc = FSFILE_GetSize(file->fd, &size);
   if(R_SUCCEEDED(rc))
   {
@@ -1081,18 +1302,31 @@ archive_diropen(struct _reent *r,
   /* get pointer to our data */
   archive_dir_t *dir = (archive_dir_t*)(dirState->dirStruct);
 
+  /* keep the path around, so that the directory can be rewound */
+  dir->path = (u16*)malloc(fs_path.size);
+  if(dir->path == NULL)
+  {
+    r->_errno = ENOMEM;
+    return NULL;
+  }
+  memcpy(dir->path, fs_path.data, fs_path.size);
+
   /* open the directory */
   rc = FSUSER_OpenDirectory(&fd, device->archive, fs_path);
   if(R_SUCCEEDED(rc))
   {
-    dir->magic = ARCHIVE_DIRITER_MAGIC;
-    dir->fd    = fd;
-    dir->index = -1;
-    dir->size  = 0;
+    dir->magic     = ARCHIVE_DIRITER_MAGIC;
+    dir->fd        = fd;
+    dir->index     = -1;
+    dir->size      = 0;
+    dir->archive   = device->archive;
+    dir->path_size = fs_path.size;
     memset(&dir->entry_data, 0, sizeof(dir->entry_data));
     return dirState;
   }
 
+  free(dir->path);
+  dir->path = NULL;
   r->_errno = archive_translate_error(rc);
   return NULL;
 }
@@ -1109,8 +1343,26 @@ static int
 archive_dirreset(struct _reent *r,
                  DIR_ITER      *dirState)
 {
-  r->_errno = ENOSYS;
-  return -1;
+  Handle  fd;
+  Result  rc;
+
+  /* get pointer to our data */
+  archive_dir_t *dir = (archive_dir_t*)(dirState->dirStruct);
+
+  /* FS directories can't be rewound, so open it again */
+  FS_Path fs_path = { PATH_UTF16, dir->path_size, dir->path };
+  rc = FSUSER_OpenDirectory(&fd, dir->archive, fs_path);
+  if(R_FAILED(rc))
+  {
+    r->_errno = archive_translate_error(rc);
+    return -1;
+  }
+
+  FSDIR_Close(dir->fd);
+  dir->fd    = fd;
+  dir->index = -1;
+  dir->size  = 0;
+  return 0;
 }
 
 /*! Fetch the next entry of an open directory
@@ -1171,12 +1423,16 @@ archive_dirnext(struct _reent *r,
   {
     entry = &dir->entry_data[dir->index];
 
-    /* fill in the stat info */
-    filestat->st_ino = 0;
+    /* fill in the stat info, matching what stat(2) would return */
+    memset(filestat, 0, sizeof(struct stat));
+    filestat->st_nlink = 1;
     if(entry->attributes & FS_ATTRIBUTE_DIRECTORY)
-      filestat->st_mode = S_IFDIR;
+      filestat->st_mode = S_IFDIR | S_IRWXU | S_IRWXG | S_IRWXO;
     else
-      filestat->st_mode = S_IFREG;
+    {
+      filestat->st_mode = S_IFREG | S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
+      filestat->st_size = (off_t)entry->fileSize;
+    }
 
     /* convert name from UTF-16 to UTF-8 */
     memset(filename, 0, NAME_MAX);
@@ -1200,6 +1456,40 @@ archive_dirnext(struct _reent *r,
   return -1;
 }
 
+Result archiveReadDir(DIR               *dirp,
+                      FS_DirectoryEntry *entries,
+                      u32               maxEntries,
+                      u32               *count)
+{
+  Result rc = 0;
+  u32    read = 0;
+
+  *count = 0;
+
+  if(dirp == NULL || dirp->dirData == NULL
+  || devoptab_list[dirp->dirData->device]->dirnext_r != archive_dirnext)
+    return MAKERESULT(RL_USAGE, RS_INVALIDARG, RM_APPLICATION, RD_INVALID_HANDLE);
+
+  archive_dir_t *dir = (archive_dir_t*)(dirp->dirData->dirStruct);
+  if(dir->magic != ARCHIVE_DIRITER_MAGIC)
+    return MAKERESULT(RL_USAGE, RS_INVALIDARG, RM_APPLICATION, RD_INVALID_HANDLE);
+
+  /* hand out what is left of the batch readdir() is working through */
+  while(*count < maxEntries && dir->index + 1 < (ssize_t)dir->size)
+    entries[(*count)++] = dir->entry_data[++dir->index];
+
+  /* then read the rest straight into the caller's buffer */
+  if(*count < maxEntries)
+  {
+    rc = FSDIR_Read(dir->fd, &read, maxEntries - *count, entries + *count);
+    if(R_SUCCEEDED(rc))
+      *count += read;
+  }
+
+  dirp->position += *count;
+  return rc;
+}
+
 /*! Close an open directory
  *
  *  @param[in,out] r        newlib reentrancy struct
@@ -1217,6 +1507,9 @@ archive_dirclose(struct _reent *r,
   /* get pointer to our data */
   archive_dir_t *dir = (archive_dir_t*)(dirState->dirStruct);
 
+  free(dir->path);
+  dir->path = NULL;
+
   /* close the directory */
   rc = FSDIR_Close(dir->fd);
   if(R_SUCCEEDED(rc))
@@ -1352,10 +1645,17 @@ archive_ftruncate(struct _reent *r,
     return -1;
   }
 
+  /* pending writes go in first, so they can be truncated too */
+  if(archive_flush(r, file) != 0)
+    return -1;
+
   /* set the new file size */
   rc = FSFILE_SetSize(file->fd, len);
   if(R_SUCCEEDED(rc))
+  {
+    file->size = len;
     return 0;
+  }
 
   r->_errno = archive_translate_error(rc);
   return -1;
@@ -1378,6 +1678,9 @@ archive_fsync(struct _reent *r,
   /* get pointer to our data */
   archive_file_t *file = (archive_file_t*)fd;
 
+  if(archive_flush(r, file) != 0)
+    return -1;
+
   rc = FSFILE_Flush(file->fd);
   if(R_SUCCEEDED(rc))
     return 0;
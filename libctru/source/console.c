@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/iosupport.h>
 #include <3ds/gfx.h>
@@ -69,7 +70,9 @@ PrintConsole defaultConsole =
 	0,		// background color
 	0,		// flags
 	0,		//print callback
-	false	//console initialized
+	false,	//console initialized
+	NULL,	//backing store
+	GSP_RGB565_OES	//framebuffer format
 };
 
 PrintConsole currentCopy;
@@ -81,6 +84,183 @@ PrintConsole* consoleGetDefault(void){return &defaultConsole;}
 void consolePrintChar(int c);
 void consoleDrawChar(int c);
 
+// A character cell of the deferred renderer, with its colors already resolved
+typedef struct
+{
+	u16 glyph; // index in the font
+	u16 flags;
+	u16 fg;
+	u16 bg;
+} ConsoleCell;
+
+// The cell grid covers the console window. Scrolling rotates the rows instead
+// of moving them, and each row remembers the range of columns that changed
+// since the last flush.
+struct ConsoleBacking
+{
+	int width;      // grid size, in characters
+	int height;
+	int top;        // grid row shown on the first window row
+	int scroll;     // rows scrolled since the last flush
+	u8* dirtyStart; // per grid row: first changed column
+	u8* dirtyEnd;   // per grid row: end of the changed columns
+	ConsoleCell cells[];
+};
+
+// Cells that were written since the last flush. The columns between two of
+// them may never have been written, so the dirty ranges alone aren't enough.
+#define CONSOLE_CELL_DIRTY (1<<15)
+
+//---------------------------------------------------------------------------------
+static void consoleBackingReset(PrintConsole* console) {
+//---------------------------------------------------------------------------------
+	ConsoleBacking* b = console->backing;
+
+	b->width = console->windowWidth < console->consoleWidth ? console->windowWidth : console->consoleWidth;
+	b->height = console->windowHeight < console->consoleHeight ? console->windowHeight : console->consoleHeight;
+	b->top = 0;
+	b->scroll = 0;
+
+	// Whatever is on screen already stays there until it is overwritten
+	memset(b->cells, 0, b->width * b->height * sizeof(ConsoleCell));
+	memset(b->dirtyStart, 0, console->consoleHeight);
+	memset(b->dirtyEnd, 0, console->consoleHeight);
+}
+
+//---------------------------------------------------------------------------------
+static void consoleStoreCell(ConsoleBacking* b, int x, int y, u16 glyph, u16 fg, u16 bg, int flags) {
+//---------------------------------------------------------------------------------
+	if (x < 0 || x >= b->width || y < 0 || y >= b->height) return;
+
+	y += b->top;
+	if (y >= b->height) y -= b->height;
+
+	ConsoleCell *cell = &b->cells[y * b->width + x];
+	cell->glyph = glyph;
+	cell->flags = flags | CONSOLE_CELL_DIRTY;
+	cell->fg = fg;
+	cell->bg = bg;
+
+	if (b->dirtyStart[y] >= b->dirtyEnd[y]) {
+		b->dirtyStart[y] = x;
+		b->dirtyEnd[y] = x + 1;
+	} else if (x < b->dirtyStart[y]) {
+		b->dirtyStart[y] = x;
+	} else if (x >= b->dirtyEnd[y]) {
+		b->dirtyEnd[y] = x + 1;
+	}
+}
+
+// Pixels for each combination of four glyph bits, in the framebuffer format, for
+// one pair of colors. Four pixels take as many words as one pixel takes bytes,
+// so every entry is a whole number of words.
+typedef struct
+{
+	bool valid;
+	GSPGPU_FramebufferFormat format;
+	u16 fg;
+	u16 bg;
+	u32 pixels[16][4];
+} GlyphTable;
+
+// A few color pairs are kept, so that colored text doesn't rebuild a table
+// at every color change
+#define GLYPH_TABLE_COUNT 8
+
+static GlyphTable glyphTables[GLYPH_TABLE_COUNT];
+static int glyphTableLast, glyphTableNext;
+
+static inline bool glyphTableMatches(const GlyphTable* table, GSPGPU_FramebufferFormat format, u16 fg, u16 bg) {
+	return table->valid && table->format == format && table->fg == fg && table->bg == bg;
+}
+
+//---------------------------------------------------------------------------------
+static const GlyphTable* consoleGetGlyphTable(GSPGPU_FramebufferFormat format, u16 fg, u16 bg) {
+//---------------------------------------------------------------------------------
+	// Runs of characters usually share their colors
+	GlyphTable *table = &glyphTables[glyphTableLast];
+	if (glyphTableMatches(table, format, fg, bg)) return table;
+
+	for (int i = 0; i < GLYPH_TABLE_COUNT; i++) {
+		if (glyphTableMatches(&glyphTables[i], format, fg, bg)) {
+			glyphTableLast = i;
+			return &glyphTables[i];
+		}
+	}
+
+	// Replace the tables in turn
+	glyphTableLast = glyphTableNext;
+	glyphTableNext = (glyphTableNext + 1) % GLYPH_TABLE_COUNT;
+	table = &glyphTables[glyphTableLast];
+
+	unsigned bpp = gspGetBytesPerPixel(format);
+	u8 colors[2][4];
+
+	for (int i = 0; i < 2; i++) {
+		u16 c = i ? fg : bg;
+		u8 r = (c >> 11) << 3;
+		u8 g = ((c >> 5) & 0x3f) << 2;
+		u8 b = (c & 0x1f) << 3;
+		r |= r >> 5;
+		g |= g >> 6;
+		b |= b >> 5;
+
+		u8 *color = colors[i];
+		switch (format) {
+			case GSP_RGBA8_OES:
+				color[0] = 0xff;
+				color[1] = b;
+				color[2] = g;
+				color[3] = r;
+				break;
+			case GSP_BGR8_OES:
+				color[0] = b;
+				color[1] = g;
+				color[2] = r;
+				break;
+			default:
+				color[0] = c;
+				color[1] = c >> 8;
+				break;
+		}
+	}
+
+	for (int n = 0; n < 16; n++) {
+		u8 *pixel = (u8*)table->pixels[n];
+		for (int i = 0; i < 4; i++) {
+			const u8 *color = colors[(n >> i) & 1];
+			for (unsigned j = 0; j < bpp; j++)
+				*pixel++ = color[j];
+		}
+	}
+
+	table->valid = true;
+	table->format = format;
+	table->fg = fg;
+	table->bg = bg;
+	return table;
+}
+
+//---------------------------------------------------------------------------------
+static void consoleScrollPixels(PrintConsole* console, int width, int height, int rows) {
+//---------------------------------------------------------------------------------
+	// Moves the top height - rows rows of the window up by rows. Each screen
+	// column is contiguous, with the bottom pixel first.
+	unsigned bpp = gspGetBytesPerPixel(console->format);
+	int base = 240 - (console->windowY - 1 + height) * 8;
+	size_t shift = rows * 8 * bpp;
+	size_t count = (height - rows) * 8 * bpp;
+	u8 *column = (u8*)console->frameBuffer + ((console->windowX - 1) * 8 * 240 + base) * bpp;
+
+	for (int i = 0; i < width * 8; i++, column += 240 * bpp)
+		memmove(column + shift, column, count);
+}
+
+// Output is only pushed to the screen on consoleFlush when rendering is deferred
+static inline void consoleFlushImmediate(void) {
+	if (!currentConsole->backing) gfxFlushBuffers();
+}
+
 //---------------------------------------------------------------------------------
 static void consoleCls(int mode) {
 //---------------------------------------------------------------------------------
@@ -130,7 +310,7 @@ static void consoleCls(int mode) {
 			break;
 		}
 	}
-	gfxFlushBuffers();
+	consoleFlushImmediate();
 }
 //---------------------------------------------------------------------------------
 static void consoleClearLine(int mode) {
@@ -175,7 +355,7 @@ static void consoleClearLine(int mode) {
 
 			break;
 	}
-	gfxFlushBuffers();
+	consoleFlushImmediate();
 }
 
 
@@ -656,6 +836,12 @@ static const devoptab_t dotab_null = {
 
 //---------------------------------------------------------------------------------
 PrintConsole* consoleInit(gfxScreen_t screen, PrintConsole* console) {
+//---------------------------------------------------------------------------------
+	return consoleInitFormat(screen, console, GSP_RGB565_OES);
+}
+
+//---------------------------------------------------------------------------------
+PrintConsole* consoleInitFormat(gfxScreen_t screen, PrintConsole* console, GSPGPU_FramebufferFormat format) {
 //---------------------------------------------------------------------------------
 
 	static bool firstConsoleInit = true;
@@ -682,7 +868,11 @@ PrintConsole* consoleInit(gfxScreen_t screen, PrintConsole* console) {
 
 	console->consoleInitialised = 1;
 
-	gfxSetScreenFormat(screen,GSP_RGB565_OES);
+	if (format != GSP_BGR8_OES && format != GSP_RGBA8_OES)
+		format = GSP_RGB565_OES;
+	console->format = format;
+
+	gfxSetScreenFormat(screen,format);
 	gfxSetDoubleBuffering(screen,false);
 	gfxSwapBuffersGpu();
 	gspWaitForVBlank();
@@ -752,30 +942,86 @@ static void newRow() {
 
 	if(currentConsole->cursorY  > currentConsole->windowHeight)  {
 		currentConsole->cursorY = currentConsole->windowHeight;
-		u16 *dst = &currentConsole->frameBuffer[((currentConsole->windowX - 1 ) * 8 * 240) + (239 - ((currentConsole->windowY) * 8))];
-		u16 *src = dst - 8;
 
-		int i,j;
-
-		for (i=0; i<(currentConsole->windowWidth)*8; i++) {
-			u32 *from = (u32*)((int)src & ~3);
-			u32 *to = (u32*)((int)dst & ~3);
-			for (j=0;j<(((currentConsole->windowHeight-2)*8)/2);j++) *(to--) = *(from--);
-			dst += 240;
-			src += 240;
+		ConsoleBacking *b = currentConsole->backing;
+		if (b) {
+			// The old first row becomes the last one; consoleFlush moves the pixels
+			b->dirtyStart[b->top] = b->dirtyEnd[b->top] = 0;
+			if (++b->top == b->height) b->top = 0;
+			if (b->scroll < b->height) b->scroll++;
+			consoleClearLine(2);
+			return;
 		}
 
+		consoleScrollPixels(currentConsole, currentConsole->windowWidth, currentConsole->windowHeight, 1);
 		consoleClearLine(2);
 	}
 }
+//---------------------------------------------------------------------------------
+static inline void consoleBlitColumns(u32* screen, const GlyphTable* table, u32 columns, unsigned words) {
+//---------------------------------------------------------------------------------
+	// Four screen columns, one per byte of columns, first column in the top byte
+	for (int i = 0; i < 4; i++, screen += 60 * words, columns <<= 8) {
+		const u32 *lo = table->pixels[(columns >> 24) & 0xf];
+		const u32 *hi = table->pixels[columns >> 28];
+		for (unsigned w = 0; w < words; w++) {
+			screen[w] = lo[w];
+			screen[words + w] = hi[w];
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------
+static inline void consoleBlitGlyph(u32* screen, const GlyphTable* table, u32 a, u32 b, unsigned words) {
+//---------------------------------------------------------------------------------
+	consoleBlitColumns(screen, table, a, words);
+	consoleBlitColumns(screen + 240 * words, table, b, words);
+}
+
+//---------------------------------------------------------------------------------
+static void consoleRenderChar(PrintConsole* console, int x, int y, int glyph, u16 fg, u16 bg, int flags) {
+//---------------------------------------------------------------------------------
+	const u8 *rows = console->font.gfx + (8 * glyph);
+
+	u32 a = (u32)rows[0] << 24 | rows[1] << 16 | rows[2] << 8 | rows[3];
+	u32 b = (u32)rows[4] << 24 | rows[5] << 16 | rows[6] << 8 | rows[7];
+
+	// Underline fills the bottom row, crossing out the middle one
+	if (flags & CONSOLE_UNDERLINE) b |= 0xff;
+
+	if (flags & CONSOLE_CROSSED_OUT) a |= 0xff;
+
+	// Transpose the glyph (Hacker's Delight, 7-3), so that each byte holds a
+	// screen column with the bottom pixel in bit 0
+	u32 t;
+
+	t = (a ^ (a >> 7)) & 0x00AA00AA; a ^= t ^ (t << 7);
+	t = (b ^ (b >> 7)) & 0x00AA00AA; b ^= t ^ (t << 7);
+	t = (a ^ (a >> 14)) & 0x0000CCCC; a ^= t ^ (t << 14);
+	t = (b ^ (b >> 14)) & 0x0000CCCC; b ^= t ^ (t << 14);
+	t = (a & 0xF0F0F0F0) | ((b >> 4) & 0x0F0F0F0F);
+	b = ((a << 4) & 0xF0F0F0F0) | (b & 0x0F0F0F0F);
+	a = t;
+
+	const GlyphTable *table = consoleGetGlyphTable(console->format, fg, bg);
+
+	// Glyphs start on an 8 pixel boundary, so the words written are aligned
+	unsigned bpp = gspGetBytesPerPixel(console->format);
+	u32 *screen = (u32*)((u8*)console->frameBuffer + ((x * 8 * 240) + (232 - y * 8)) * bpp);
+
+	switch (bpp) {
+		case 2: consoleBlitGlyph(screen, table, a, b, 2); break;
+		case 3: consoleBlitGlyph(screen, table, a, b, 3); break;
+		default: consoleBlitGlyph(screen, table, a, b, 4); break;
+	}
+}
+
 //---------------------------------------------------------------------------------
 void consoleDrawChar(int c) {
 //---------------------------------------------------------------------------------
 	c -= currentConsole->font.asciiOffset;
 	if ( c < 0 || c > currentConsole->font.numChars ) return;
 
-	u8 *fontdata = currentConsole->font.gfx + (8 * c);
-
 	u16 fg = currentConsole->fg;
 	u16 bg = currentConsole->bg;
 
@@ -799,42 +1045,15 @@ void consoleDrawChar(int c) {
 		bg = tmp;
 	}
 
-	u8 b1 = *(fontdata++);
-	u8 b2 = *(fontdata++);
-	u8 b3 = *(fontdata++);
-	u8 b4 = *(fontdata++);
-	u8 b5 = *(fontdata++);
-	u8 b6 = *(fontdata++);
-	u8 b7 = *(fontdata++);
-	u8 b8 = *(fontdata++);
-
-	if (currentConsole->flags & CONSOLE_UNDERLINE) b8 = 0xff;
+	int x = currentConsole->cursorX - 1;
+	int y = currentConsole->cursorY - 1;
 
-	if (currentConsole->flags & CONSOLE_CROSSED_OUT) b4 = 0xff;
-
-	u8 mask = 0x80;
-
-
-	int i;
-
-	int x = (currentConsole->cursorX - 1 + currentConsole->windowX - 1 ) * 8;
-	int y = ((currentConsole->cursorY - 1 + currentConsole->windowY - 1 ) *8 );
-
-	u16 *screen = &currentConsole->frameBuffer[(x * 240) + (239 - (y + 7))];
-
-	for (i=0;i<8;i++) {
-		if (b8 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b7 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b6 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b5 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b4 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b3 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b2 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b1 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		mask >>= 1;
-		screen += 240 - 8;
+	if (currentConsole->backing) {
+		consoleStoreCell(currentConsole->backing, x, y, c, fg, bg, currentConsole->flags);
+		return;
 	}
 
+	consoleRenderChar(currentConsole, x + currentConsole->windowX - 1, y + currentConsole->windowY - 1, c, fg, bg, currentConsole->flags);
 }
 
 //---------------------------------------------------------------------------------
@@ -881,7 +1100,7 @@ void consolePrintChar(int c) {
 			newRow();
 		case 13:
 			currentConsole->cursorX  = 1;
-			gfxFlushBuffers();
+			consoleFlushImmediate();
 			break;
 		default:
 			if(currentConsole->cursorX  > currentConsole->windowWidth) {
@@ -907,6 +1126,9 @@ void consoleSetWindow(PrintConsole* console, int x, int y, int width, int height
 
 	if(!console) console = currentConsole;
 
+	// Pending output belongs to the old window
+	if (console->backing) consoleFlush(console);
+
 	if (x < 1) x = 1;
 	if (y < 1) y = 1;
 
@@ -918,4 +1140,71 @@ void consoleSetWindow(PrintConsole* console, int x, int y, int width, int height
 	console->cursorX = 1;
 	console->cursorY = 1;
 
+	if (console->backing) consoleBackingReset(console);
+}
+
+//---------------------------------------------------------------------------------
+bool consoleSetDeferred(PrintConsole* console, bool enable) {
+//---------------------------------------------------------------------------------
+
+	if(!console) console = currentConsole;
+
+	if (!enable) {
+		if (console->backing) {
+			consoleFlush(console);
+			free(console->backing);
+			console->backing = NULL;
+		}
+		return true;
+	}
+
+	if (console->backing) return true;
+
+	// Sized for the whole console, so that any window fits
+	size_t cellCount = console->consoleWidth * console->consoleHeight;
+	ConsoleBacking *b = (ConsoleBacking*)malloc(sizeof(ConsoleBacking) + cellCount * sizeof(ConsoleCell) + 2 * console->consoleHeight);
+	if (!b) return false;
+
+	b->dirtyStart = (u8*)&b->cells[cellCount];
+	b->dirtyEnd = b->dirtyStart + console->consoleHeight;
+
+	console->backing = b;
+	consoleBackingReset(console);
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+void consoleFlush(PrintConsole* console) {
+//---------------------------------------------------------------------------------
+
+	if(!console) console = currentConsole;
+
+	ConsoleBacking *b = console->backing;
+	if (b) {
+		int x0 = console->windowX - 1;
+		int y0 = console->windowY - 1;
+		int row, col;
+
+		// Move the rows still on screen once, however many lines were printed.
+		// If all of them scrolled away, every cell was rewritten anyway.
+		if (b->scroll && b->scroll < b->height)
+			consoleScrollPixels(console, b->width, b->height, b->scroll);
+		b->scroll = 0;
+
+		for (row = 0; row < b->height; row++) {
+			int r = b->top + row;
+			if (r >= b->height) r -= b->height;
+
+			ConsoleCell *cells = &b->cells[r * b->width];
+			for (col = b->dirtyStart[r]; col < b->dirtyEnd[r]; col++) {
+				if (!(cells[col].flags & CONSOLE_CELL_DIRTY)) continue;
+				cells[col].flags &= ~CONSOLE_CELL_DIRTY;
+				consoleRenderChar(console, x0 + col, y0 + row, cells[col].glyph, cells[col].fg, cells[col].bg, cells[col].flags);
+			}
+
+			b->dirtyStart[r] = b->dirtyEnd[r] = 0;
+		}
+	}
+
+	gfxFlushBuffers();
 }
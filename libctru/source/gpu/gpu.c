@@ -6,6 +6,9 @@
 #include <string.h>
 #include <3ds/types.h>
 #include <3ds/svc.h>
+#include <3ds/os.h>
+#include <3ds/allocator/linear.h>
+#include <3ds/services/gspgpu.h>
 #include <3ds/gpu/gpu.h>
 #include <3ds/gpu/gx.h>
 #include <3ds/gpu/shbin.h>
@@ -14,18 +17,698 @@ u32* gpuCmdBuf;
 u32 gpuCmdBufSize;
 u32 gpuCmdBufOffset;
 
+#define GPUSHADOW_NUM_UNIFORMS 96
+
+typedef struct
+{
+	u32 data[GPUSHADOW_NUM_UNIFORMS][4]; // Last value uploaded to each uniform
+	u8 mode[GPUSHADOW_NUM_UNIFORMS];     // Words per uniform of that upload, 0 if unknown
+	u32 pending[4];                      // Words of a partially uploaded uniform
+	u32 config, word;                    // Uniform pointer the recorded commands expect
+	u32 gpuConfig, gpuWord;              // Uniform pointer the GPU will actually use
+	bool valid, gpuValid;
+	bool deferred;                       // A pointer write was recorded but not emitted yet
+} GPUShadowUniforms;
+
+typedef struct
+{
+	u32 regs[0x400];
+	u8 known[0x400];                 // Masks of the bytes of regs[] that are known
+	GPUShadowUniforms uniforms[2];   // Geometry and vertex shader units
+	GPUCMD_ShadowStats stats;
+} GPUShadow;
+
+static GPUShadow* gpuShadow;
+
+static void GPUCMD_AddChunked(u32 header, const u32* param, u32 paramlength);
+
+static u32 GPUCMD_CommandSize(u32 paramlength)
+{
+	u32 size = 0;
+	while (paramlength)
+	{
+		u32 remaining = paramlength > 0x100 ? 0x100 : paramlength;
+		size += remaining + 1 + ((remaining-1) & 1);
+		paramlength -= remaining;
+	}
+	return size;
+}
+
+static void GPUCMD_ShadowCount(u32 writes, u32 size)
+{
+	gpuShadow->stats.writes += writes;
+	gpuShadow->stats.bytes  += size*4;
+}
+
+static inline u32 GPUCMD_ByteMask(u32 mask)
+{
+	// Spread the four mask bits to the low bit of each byte, then fill the bytes
+	return ((mask * 0x204081) & 0x01010101) * 0xFF;
+}
+
+// Registers that trigger an action, feed a data port or move a data port's
+// pointer can't be skipped even if they are written the same value again
+static bool GPUCMD_ShadowCacheable(u32 reg)
+{
+	switch (reg)
+	{
+		case 0x0000 ... GPUREG_003F:
+		case GPUREG_EARLYDEPTH_CLEAR:
+		case GPUREG_TEXUNIT_CONFIG: // Also clears the texture cache
+		case GPUREG_PROCTEX_LUT ... GPUREG_PROCTEX_LUT_DATA7:
+		case GPUREG_FOG_LUT_INDEX ... GPUREG_FOG_LUT_DATA7:
+		case GPUREG_FRAMEBUFFER_INVALIDATE:
+		case GPUREG_FRAMEBUFFER_FLUSH:
+		case GPUREG_GAS_LUT_INDEX ... GPUREG_GAS_LUT_DATA:
+		case GPUREG_LIGHTING_LUT_INDEX ... GPUREG_LIGHTING_LUT_DATA7:
+		case GPUREG_DRAWARRAYS ... GPUREG_FIXEDATTRIB_DATA2:
+		case GPUREG_CMDBUF_SIZE0 ... GPUREG_CMDBUF_JUMP1:
+		case GPUREG_START_DRAW_FUNC0:
+		case GPUREG_RESTART_PRIMITIVE:
+		case GPUREG_GSH_CODETRANSFER_END ... GPUREG_GSH_FLOATUNIFORM_DATA+7:
+		case GPUREG_GSH_CODETRANSFER_CONFIG ... GPUREG_GSH_CODETRANSFER_DATA+7:
+		case GPUREG_GSH_OPDESCS_CONFIG ... GPUREG_GSH_OPDESCS_DATA+7:
+		case GPUREG_VSH_CODETRANSFER_END ... GPUREG_VSH_FLOATUNIFORM_DATA+7:
+		case GPUREG_VSH_CODETRANSFER_CONFIG ... GPUREG_VSH_CODETRANSFER_DATA+7:
+		case GPUREG_VSH_OPDESCS_CONFIG ... GPUREG_VSH_OPDESCS_DATA+7:
+		case 0x0300 ... 0x03FF:
+			return false;
+	}
+	return true;
+}
+
+// Returns the float uniform unit a register belongs to, or -1
+static int GPUCMD_ShadowUniformUnit(u32 reg)
+{
+	if (reg >= GPUREG_GSH_FLOATUNIFORM_CONFIG && reg <= GPUREG_GSH_FLOATUNIFORM_DATA+7)
+		return 0;
+	if (reg >= GPUREG_VSH_FLOATUNIFORM_CONFIG && reg <= GPUREG_VSH_FLOATUNIFORM_DATA+7)
+		return 1;
+	return -1;
+}
+
+static void GPUCMD_ShadowLoseUniforms(GPUShadowUniforms* u)
+{
+	memset(u->mode, 0, sizeof(u->mode));
+	u->valid    = false;
+	u->gpuValid = false;
+	u->deferred = false;
+}
+
+enum
+{
+	GPUSHADOW_MIRROR_UNKNOWN,
+	GPUSHADOW_MIRROR_ON,
+	GPUSHADOW_MIRROR_OFF,
+};
+
+// Unless the geometry shader unit is configured separately, vertex shader
+// register writes are mirrored to the geometry shader registers
+static int GPUCMD_ShadowMirror(void)
+{
+	if (!(gpuShadow->known[GPUREG_VSH_COM_MODE] & 1))
+		return GPUSHADOW_MIRROR_UNKNOWN;
+	return (gpuShadow->regs[GPUREG_VSH_COM_MODE] & 1) ? GPUSHADOW_MIRROR_OFF : GPUSHADOW_MIRROR_ON;
+}
+
+static inline bool GPUCMD_ShadowMirrored(u32 reg)
+{
+	return reg >= GPUREG_VSH_BOOLUNIFORM && reg <= GPUREG_02DF;
+}
+
+// Emits the pointer write the GPU skipped because of dropped or deferred uploads
+static void GPUCMD_ShadowSyncUniforms(int unit)
+{
+	GPUShadowUniforms* u = &gpuShadow->uniforms[unit];
+	if (!u->valid || (u->gpuValid && u->gpuConfig == u->config && u->gpuWord == u->word))
+		return;
+
+	if (u->word)
+	{
+		// A pointer in the middle of a uniform can't be restored
+		GPUCMD_ShadowLoseUniforms(u);
+		return;
+	}
+
+	GPUCMD_AddChunked(GPUCMD_HEADER(0, 0xF, unit ? GPUREG_VSH_FLOATUNIFORM_CONFIG : GPUREG_GSH_FLOATUNIFORM_CONFIG), &u->config, 1);
+	if (!u->deferred)
+	{
+		// Give back what was counted as saved when the pointer write was dropped
+		if (gpuShadow->stats.writes) gpuShadow->stats.writes -= 1;
+		if (gpuShadow->stats.bytes)  gpuShadow->stats.bytes  -= 8;
+	}
+
+	u->deferred  = false;
+	u->gpuConfig = u->config;
+	u->gpuWord   = 0;
+	u->gpuValid  = true;
+
+	if (unit)
+	{
+		// The geometry shader pointer moves along, whatever it is expected to be
+		GPUShadowUniforms* g = &gpuShadow->uniforms[0];
+		int mirror = GPUCMD_ShadowMirror();
+		if (mirror == GPUSHADOW_MIRROR_ON)
+		{
+			g->gpuConfig = u->config;
+			g->gpuWord   = 0;
+			g->gpuValid  = true;
+		} else if (mirror == GPUSHADOW_MIRROR_UNKNOWN)
+			g->gpuValid = false;
+	}
+}
+
+static void GPUCMD_ShadowSetUniformPointer(GPUShadowUniforms* u, u32 config)
+{
+	if (u->deferred)
+	{
+		// The previous pointer write is superseded before anything used it
+		GPUCMD_ShadowCount(1, 2);
+		u->deferred = false;
+	}
+
+	u->config = config;
+	u->word   = 0;
+	u->valid  = true;
+}
+
+static bool GPUCMD_ShadowUniformsMatch(GPUShadowUniforms* u, u32 config, const u32* param, u32 count)
+{
+	u32 words = (config & BIT(31)) ? 4 : 3;
+	u32 index = config & 0xFF;
+	if (!param || !count || count % words || index + count/words > GPUSHADOW_NUM_UNIFORMS)
+		return false;
+
+	for (u32 i = 0; i < count; i += words, index ++)
+		if (u->mode[index] != words || memcmp(u->data[index], &param[i], words*4) != 0)
+			return false;
+	return true;
+}
+
+// Records uploaded data at the uniform pointer, which must match the GPU's
+static void GPUCMD_ShadowFeedUniforms(GPUShadowUniforms* u, const u32* param, u32 count)
+{
+	if (!u->valid)
+		return;
+
+	u32 words = (u->config & BIT(31)) ? 4 : 3;
+	for (u32 i = 0; i < count; i ++)
+	{
+		u->pending[u->word++] = param ? param[i] : 0;
+		if (u->word < words)
+			continue;
+
+		u32 index = u->config & 0xFF;
+		if (index >= GPUSHADOW_NUM_UNIFORMS)
+		{
+			GPUCMD_ShadowLoseUniforms(u);
+			return;
+		}
+
+		memcpy(u->data[index], u->pending, words*4);
+		u->mode[index] = words;
+		u->config ++;
+		u->word = 0;
+	}
+
+	u->gpuConfig = u->config;
+	u->gpuWord   = u->word;
+	u->gpuValid  = true;
+}
+
+// Brings the shadow up to date with a command that was emitted
+static void GPUCMD_ShadowUpdate(u32 header, const u32* param, u32 paramlength)
+{
+	u32 reg = header & 0x3FF;
+	u32 mask = (header >> 16) & 0xF;
+	u32 bytemask = GPUCMD_ByteMask(mask);
+	int mirror = GPUCMD_ShadowMirror();
+
+	for (u32 i = 0; i < paramlength; i ++)
+	{
+		u32 r = (header & BIT(31)) ? reg + i : reg;
+		if (r >= 0x400)
+			break;
+
+		u32 val = param ? param[i] : 0;
+		bool cacheable = GPUCMD_ShadowCacheable(r);
+		if (cacheable)
+		{
+			gpuShadow->regs[r] = (gpuShadow->regs[r] &~ bytemask) | (val & bytemask);
+			gpuShadow->known[r] |= mask;
+		} else if (GPUCMD_ShadowUniformUnit(r) >= 0)
+			GPUCMD_ShadowLoseUniforms(&gpuShadow->uniforms[GPUCMD_ShadowUniformUnit(r)]);
+
+		if (!GPUCMD_ShadowMirrored(r) || mirror == GPUSHADOW_MIRROR_OFF)
+			continue;
+
+		if (cacheable && mirror == GPUSHADOW_MIRROR_ON)
+		{
+			gpuShadow->regs[r-0x30] = (gpuShadow->regs[r-0x30] &~ bytemask) | (val & bytemask);
+			gpuShadow->known[r-0x30] |= mask;
+		} else
+		{
+			gpuShadow->known[r-0x30] = 0;
+			if (GPUCMD_ShadowUniformUnit(r) >= 0)
+				GPUCMD_ShadowLoseUniforms(&gpuShadow->uniforms[0]);
+		}
+	}
+}
+
+// Float uniform uploads are tracked per uniform rather than per register, as
+// the data registers are ports feeding the uniform pointed to by the config
+// register. Returns false if the command doesn't have a shape the shadow
+// understands.
+static bool GPUCMD_ShadowAddUniforms(int unit, u32 header, const u32* param, u32 paramlength)
+{
+	GPUShadowUniforms* u = &gpuShadow->uniforms[unit];
+	GPUShadowUniforms* g = &gpuShadow->uniforms[0];
+	u32 base = unit ? GPUREG_VSH_FLOATUNIFORM_CONFIG : GPUREG_GSH_FLOATUNIFORM_CONFIG;
+	u32 reg = header & 0x3FF;
+	bool incremental = header & BIT(31);
+	int mirror = unit ? GPUCMD_ShadowMirror() : GPUSHADOW_MIRROR_OFF;
+
+	if (((header >> 16) & 0xF) != 0xF || (incremental && reg + paramlength - 1 > base + 8))
+		return false;
+
+	const u32* data = param;
+	u32 count = paramlength;
+	bool withConfig = reg == base;
+	if (withConfig)
+	{
+		if (!param || (!incremental && paramlength > 1))
+			return false;
+		data ++;
+		count --;
+	} else if (!u->valid)
+		return false;
+
+	u32 config = withConfig ? param[0] : u->config;
+	bool skip = (withConfig || !u->word) && (!count || GPUCMD_ShadowUniformsMatch(u, config, data, count));
+
+	// Mirrored uploads are only redundant if they don't change the geometry
+	// shader uniforms either
+	if (skip && mirror != GPUSHADOW_MIRROR_OFF)
+		skip = mirror == GPUSHADOW_MIRROR_ON && (withConfig || (g->valid && g->config == config && !g->word))
+			&& (!count || GPUCMD_ShadowUniformsMatch(g, config, data, count));
+
+	if (skip)
+	{
+		if (withConfig)
+		{
+			GPUCMD_ShadowSetUniformPointer(u, config);
+			if (mirror == GPUSHADOW_MIRROR_ON)
+				GPUCMD_ShadowSetUniformPointer(g, config);
+		}
+
+		if (count)
+		{
+			u32 words = (config & BIT(31)) ? 4 : 3;
+			u->config += count / words;
+			if (mirror == GPUSHADOW_MIRROR_ON)
+				g->config = u->config;
+			GPUCMD_ShadowCount(paramlength, GPUCMD_CommandSize(paramlength));
+		} else if (u->gpuValid && u->gpuConfig == config && !u->gpuWord
+			&& (mirror == GPUSHADOW_MIRROR_OFF || (g->gpuValid && g->gpuConfig == config && !g->gpuWord)))
+			GPUCMD_ShadowCount(1, 2);
+		else
+		{
+			// Only data uploads depend on the pointer, so wait for one before
+			// emitting the pointer write
+			u->deferred = true;
+		}
+		return true;
+	}
+
+	if (withConfig)
+	{
+		// The command sets the pointer itself. If it may or may not be
+		// mirrored, the geometry shader pointer has to be in place first.
+		if (mirror == GPUSHADOW_MIRROR_UNKNOWN)
+			GPUCMD_ShadowSyncUniforms(0);
+
+		GPUCMD_ShadowSetUniformPointer(u, config);
+		u->gpuValid = false;
+		if (mirror == GPUSHADOW_MIRROR_ON)
+		{
+			GPUCMD_ShadowSetUniformPointer(g, config);
+			g->gpuValid = false;
+		}
+	} else
+	{
+		GPUCMD_ShadowSyncUniforms(unit);
+		if (mirror != GPUSHADOW_MIRROR_OFF)
+			GPUCMD_ShadowSyncUniforms(0);
+	}
+
+	GPUCMD_AddChunked(header, param, paramlength);
+	GPUCMD_ShadowFeedUniforms(u, data, count);
+	if (mirror == GPUSHADOW_MIRROR_ON && g->valid && (withConfig || g->gpuValid))
+		GPUCMD_ShadowFeedUniforms(g, data, count);
+	else if (mirror != GPUSHADOW_MIRROR_OFF)
+		GPUCMD_ShadowLoseUniforms(g);
+	return true;
+}
+
+static void GPUCMD_ShadowAdd(u32 header, const u32* param, u32 paramlength)
+{
+	u32 reg = header & 0x3FF;
+	u32 mask = (header >> 16) & 0xF;
+	bool incremental = header & BIT(31);
+
+	int unit = GPUCMD_ShadowUniformUnit(reg);
+	if (unit >= 0)
+	{
+		// A vertex shader pointer write emitted later would also move the
+		// geometry shader pointer, so get it out of the way first
+		if (!unit && GPUCMD_ShadowMirror() != GPUSHADOW_MIRROR_OFF)
+			GPUCMD_ShadowSyncUniforms(1);
+
+		if (GPUCMD_ShadowAddUniforms(unit, header, param, paramlength))
+			return;
+
+		// Put the uniform pointers where the command expects them
+		GPUCMD_ShadowSyncUniforms(unit);
+		if (unit && GPUCMD_ShadowMirror() != GPUSHADOW_MIRROR_OFF)
+			GPUCMD_ShadowSyncUniforms(0);
+	}
+
+	// Only writes to state registers, each written once, can be dropped
+	bool cacheable = mask && (incremental || paramlength == 1) && unit < 0;
+	for (u32 i = 0; cacheable && i < paramlength; i ++)
+		cacheable = reg + i < 0x400 && GPUCMD_ShadowCacheable(reg + i);
+
+	if (cacheable)
+	{
+		u32 bytemask = GPUCMD_ByteMask(mask);
+		bool mirror = GPUCMD_ShadowMirror() != GPUSHADOW_MIRROR_OFF;
+		u32 first = paramlength, last = 0;
+		for (u32 i = 0; i < paramlength; i ++)
+		{
+			u32 r = reg + i, val = param ? param[i] : 0;
+			bool same = (gpuShadow->known[r] & mask) == mask && !((gpuShadow->regs[r] ^ val) & bytemask);
+			if (same && mirror && GPUCMD_ShadowMirrored(r))
+				same = (gpuShadow->known[r-0x30] & mask) == mask && !((gpuShadow->regs[r-0x30] ^ val) & bytemask);
+			if (!same)
+			{
+				if (first == paramlength) first = i;
+				last = i;
+			}
+		}
+
+		if (first == paramlength)
+		{
+			GPUCMD_ShadowCount(paramlength, GPUCMD_CommandSize(paramlength));
+			return;
+		}
+
+		// Only emit the span of registers that actually change
+		u32 length = last - first + 1;
+		GPUCMD_ShadowCount(paramlength - length, GPUCMD_CommandSize(paramlength) - GPUCMD_CommandSize(length));
+		header += first;
+		if (param) param += first;
+		paramlength = length;
+	}
+
+	GPUCMD_AddChunked(header, param, paramlength);
+	GPUCMD_ShadowUpdate(header, param, paramlength);
+}
+
+bool GPUCMD_EnableShadow(bool enable)
+{
+	if (!enable)
+	{
+		if (gpuShadow)
+		{
+			// Commands recorded from now on expect the uniform pointers to be in place
+			GPUCMD_ShadowSyncUniforms(1);
+			GPUCMD_ShadowSyncUniforms(0);
+			free(gpuShadow);
+			gpuShadow = NULL;
+		}
+		return true;
+	}
+
+	if (!gpuShadow)
+	{
+		// Everything starts out unknown
+		gpuShadow = (GPUShadow*)calloc(1, sizeof(GPUShadow));
+		if (!gpuShadow) return false;
+	}
+	return true;
+}
+
+void GPUCMD_InvalidateShadow(void)
+{
+	if (!gpuShadow) return;
+
+	memset(gpuShadow->known, 0, sizeof(gpuShadow->known));
+	for (int i = 0; i < 2; i ++)
+	{
+		GPUShadowUniforms* u = &gpuShadow->uniforms[i];
+		memset(u->mode, 0, sizeof(u->mode));
+		u->gpuValid = false;
+
+		// A pointer left in the middle of a uniform can't be restored
+		if (u->word)
+			u->valid = false;
+	}
+}
+
+void GPUCMD_GetShadowStats(GPUCMD_ShadowStats* stats, bool reset)
+{
+	if (!gpuShadow)
+	{
+		if (stats) memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	if (stats) *stats = gpuShadow->stats;
+	if (reset) memset(&gpuShadow->stats, 0, sizeof(gpuShadow->stats));
+}
+
+typedef struct GPUCmdChunk GPUCmdChunk;
+
+struct GPUCmdChunk
+{
+	GPUCmdChunk* next;
+	u32* data;
+	u32 size;  // In words
+	u32 fence; // Last command list recorded into the chunk
+};
+
+// Room kept at the end of each chunk for the jump to the next one
+#define GPUCHAIN_JUMP_WORDS 8
+
+static u32 gpuChainChunkSize;
+static GPUCmdChunk* gpuChainCur;
+static GPUCmdChunk *gpuChainUsed, *gpuChainUsedTail; // Oldest first
+static GPUCmdChunk* gpuChainFree;
+static u32 gpuChainFreeCount;
+static u32 gpuChainFence;     // Fence of the command list being recorded
+static u32* gpuChainListAddr; // Start of the command list being recorded
+static u32 gpuChainListSize;  // Size of its first segment, or 0 if it has only one
+static u32* gpuChainJumpSize; // Size parameter of the last jump
+
+static GPUCmdChunk* GPUCMD_ChainGetChunk(u32 size)
+{
+	for (GPUCmdChunk** p = &gpuChainFree; *p; p = &(*p)->next)
+	{
+		GPUCmdChunk* c = *p;
+		if (c->size < size) continue;
+		*p = c->next;
+		gpuChainFreeCount--;
+		return c;
+	}
+
+	if (size < gpuChainChunkSize)
+		size = gpuChainChunkSize;
+
+	GPUCmdChunk* c = (GPUCmdChunk*)malloc(sizeof(GPUCmdChunk));
+	if (!c) return NULL;
+
+	c->data = (u32*)linearAlloc(size*4);
+	if (!c->data)
+	{
+		free(c);
+		return NULL;
+	}
+
+	c->size = size;
+	return c;
+}
+
+static void GPUCMD_ChainFreeChunks(GPUCmdChunk* c)
+{
+	while (c)
+	{
+		GPUCmdChunk* next = c->next;
+		linearFree(c->data);
+		free(c);
+		c = next;
+	}
+}
+
+static void GPUCMD_ChainPatchJump(void)
+{
+	// The size of the segment the last jump leads to is only known once it ends
+	if (gpuChainJumpSize)
+	{
+		*gpuChainJumpSize = gpuCmdBufOffset/2;
+		gpuChainJumpSize = NULL;
+	}
+}
+
+// Continues the command list in another chunk with room for at least size words
+static bool GPUCMD_ChainGrow(u32 size)
+{
+	GPUCmdChunk* c = GPUCMD_ChainGetChunk(size + GPUCHAIN_JUMP_WORDS);
+	if (!c) return false;
+
+	// The jump has to be the last command of the segment, which must end on a
+	// 16-byte boundary; the address is written twice to pad it if needed
+	u32* cmd = &gpuCmdBuf[gpuCmdBufOffset];
+	u32 addr = osConvertVirtToPhys(c->data) >> 3;
+	u32 n = 0;
+	cmd[n++] = 0;
+	cmd[n++] = GPUCMD_HEADER(0, 0xF, GPUREG_CMDBUF_SIZE0);
+	cmd[n++] = addr;
+	if (gpuCmdBufOffset & 2)
+		cmd[n++] = GPUCMD_HEADER(0, 0xF, GPUREG_CMDBUF_ADDR0);
+	else
+	{
+		cmd[n++] = GPUCMD_HEADER(0, 0xF, GPUREG_CMDBUF_ADDR0) | (1<<20);
+		cmd[n++] = addr;
+		cmd[n++] = 0;
+	}
+	cmd[n++] = 1;
+	cmd[n++] = GPUCMD_HEADER(0, 0xF, GPUREG_CMDBUF_JUMP0);
+	gpuCmdBufOffset += n;
+
+	GPUCMD_ChainPatchJump();
+	gpuChainJumpSize = cmd;
+	if (!gpuChainListSize)
+		gpuChainListSize = gpuCmdBufOffset;
+
+	GPUCmdChunk* prev = gpuChainCur;
+	prev->fence = gpuChainFence;
+	prev->next = NULL;
+	if (gpuChainUsedTail)
+		gpuChainUsedTail->next = prev;
+	else
+		gpuChainUsed = prev;
+	gpuChainUsedTail = prev;
+
+	c->next = NULL;
+	gpuChainCur = c;
+	gpuCmdBuf = c->data;
+	gpuCmdBufSize = c->size - GPUCHAIN_JUMP_WORDS;
+	gpuCmdBufOffset = 0;
+	return true;
+}
+
+static void GPUCMD_Overflow(u32 size)
+{
+	if (!gpuChainCur || !GPUCMD_ChainGrow(size))
+		svcBreak(USERBREAK_PANIC); // Shouldn't happen.
+}
+
+bool GPUCMD_SetChainedBuffer(u32 chunkSize)
+{
+	if (gpuChainCur)
+		return false;
+
+	gpuChainChunkSize = chunkSize < 0x100 ? 0x100 : chunkSize;
+	gpuChainCur = GPUCMD_ChainGetChunk(gpuChainChunkSize);
+	if (!gpuChainCur)
+		return false;
+
+	gpuChainCur->next = NULL;
+	gpuChainListAddr = gpuChainCur->data;
+	gpuChainListSize = 0;
+	gpuChainJumpSize = NULL;
+	GPUCMD_SetBuffer(gpuChainCur->data, gpuChainCur->size - GPUCHAIN_JUMP_WORDS, 0);
+	return true;
+}
+
+void GPUCMD_FreeChainedBuffer(void)
+{
+	if (!gpuChainCur)
+		return;
+
+	GPUCMD_ChainFreeChunks(gpuChainCur);
+	GPUCMD_ChainFreeChunks(gpuChainUsed);
+	GPUCMD_ChainFreeChunks(gpuChainFree);
+	gpuChainCur = NULL;
+	gpuChainUsed = gpuChainUsedTail = NULL;
+	gpuChainFree = NULL;
+	gpuChainFreeCount = 0;
+	GPUCMD_SetBuffer(NULL, 0, 0);
+}
+
+u32 GPUCMD_GetChainFence(void)
+{
+	return gpuChainFence - 1;
+}
+
+void GPUCMD_RecycleChain(u32 fence)
+{
+	u32 recycled = 0;
+	while (gpuChainUsed && (s32)(gpuChainUsed->fence - fence) <= 0)
+	{
+		GPUCmdChunk* c = gpuChainUsed;
+		gpuChainUsed = c->next;
+		if (!gpuChainUsed)
+			gpuChainUsedTail = NULL;
+
+		c->next = gpuChainFree;
+		gpuChainFree = c;
+		gpuChainFreeCount++;
+		recycled++;
+	}
+
+	// Keep about as many chunks around as the retired lists needed, so that
+	// memory isn't held on to after an unusually large frame
+	while (recycled && gpuChainFreeCount > recycled)
+	{
+		GPUCmdChunk* c = gpuChainFree;
+		gpuChainFree = c->next;
+		gpuChainFreeCount--;
+		c->next = NULL;
+		GPUCMD_ChainFreeChunks(c);
+	}
+}
+
 void GPUCMD_AddRawCommands(const u32* cmd, u32 size)
 {
 	if(!cmd || !size)return;
 
+	if(gpuShadow)
+	{
+		// Raw commands may upload uniforms relying on the pointer, and may
+		// change any register behind the shadow's back
+		GPUCMD_ShadowSyncUniforms(1);
+		GPUCMD_ShadowSyncUniforms(0);
+	}
+
+	if(!gpuCmdBuf || gpuCmdBufOffset+size>gpuCmdBufSize)
+		GPUCMD_Overflow(size);
+
 	memcpy(&gpuCmdBuf[gpuCmdBufOffset], cmd, size*4);
 	gpuCmdBufOffset+=size;
+
+	if(gpuShadow)
+	{
+		GPUCMD_InvalidateShadow();
+		GPUCMD_ShadowLoseUniforms(&gpuShadow->uniforms[0]);
+		GPUCMD_ShadowLoseUniforms(&gpuShadow->uniforms[1]);
+	}
 }
 
 static void GPUCMD_AddInternal(u32 header, const u32* param, u32 paramlength)
 {
-	if(!gpuCmdBuf || gpuCmdBufOffset+paramlength+1>gpuCmdBufSize)
-		svcBreak(USERBREAK_PANIC); // Shouldn't happen.
+	if(!gpuCmdBuf || gpuCmdBufOffset+GPUCMD_CommandSize(paramlength)>gpuCmdBufSize)
+		GPUCMD_Overflow(GPUCMD_CommandSize(paramlength));
 
 	paramlength--;
 	header|=(paramlength&0xff)<<20;
@@ -44,28 +727,58 @@ static void GPUCMD_AddInternal(u32 header, const u32* param, u32 paramlength)
 	if(paramlength&1)gpuCmdBuf[gpuCmdBufOffset++]=0x00000000; //alignment
 }
 
-void GPUCMD_Add(u32 header, const u32* param, u32 paramlength)
+static void GPUCMD_AddChunked(u32 header, const u32* param, u32 paramlength)
 {
-	if(!paramlength)paramlength=1;
-
 	while(paramlength)
 	{
 		u32 remaining = paramlength > 0x100 ? 0x100 : paramlength;
 		GPUCMD_AddInternal(header, param, remaining);
-		param += remaining;
+		if(param) param += remaining;
 		paramlength -= remaining;
 		if(header & BIT(31)) header += remaining;
 	}
 }
 
+void GPUCMD_Add(u32 header, const u32* param, u32 paramlength)
+{
+	if(!paramlength)paramlength=1;
+
+	if(gpuShadow)
+		GPUCMD_ShadowAdd(header, param, paramlength);
+	else
+		GPUCMD_AddChunked(header, param, paramlength);
+}
+
 void GPUCMD_Split(u32** addr, u32* size)
 {
 	GPUCMD_AddWrite(GPUREG_FINALIZE, 0x12345678);
 	if (gpuCmdBufOffset & 3)
 		GPUCMD_AddWrite(GPUREG_FINALIZE, 0x12345678); // 16-byte align the buffer
 
-	if (addr) *addr = gpuCmdBuf;
-	if (size) *size = gpuCmdBufOffset;
+	if (gpuChainCur)
+	{
+		GPUCMD_ChainPatchJump();
+		if (addr) *addr = gpuChainListAddr;
+		if (size) *size = gpuChainListSize ? gpuChainListSize : gpuCmdBufOffset;
+
+		if (gpuChainListSize)
+		{
+			// The GPU is only told about the first segment, so the ones it
+			// jumps to have to be flushed here
+			for (GPUCmdChunk* c = gpuChainUsed; c; c = c->next)
+				if (c->fence == gpuChainFence)
+					GSPGPU_FlushDataCache(c->data, c->size*4);
+			GSPGPU_FlushDataCache(gpuChainCur->data, (gpuCmdBuf + gpuCmdBufOffset - gpuChainCur->data)*4);
+		}
+
+		gpuChainCur->fence = gpuChainFence++;
+		gpuChainListAddr = gpuCmdBuf + gpuCmdBufOffset;
+		gpuChainListSize = 0;
+	} else
+	{
+		if (addr) *addr = gpuCmdBuf;
+		if (size) *size = gpuCmdBufOffset;
+	}
 
 	gpuCmdBuf       += gpuCmdBufOffset;
 	gpuCmdBufSize   -= gpuCmdBufOffset;
@@ -83,7 +796,7 @@ static inline u32 floatrawbits(float f)
 //  - 1 sign bit
 //  - 5 exponent bits
 //  - 10 mantissa bits
-u32 f32tof16(float f)
+static inline u32 f32tof16Inline(float f)
 {
 	u32 i = floatrawbits(f);
 
@@ -96,18 +809,26 @@ u32 f32tof16(float f)
 
 	// Re-bias exponent
 	exponent = exponent - 127 + 15;
+
+	// Selects rather than early returns keep the loops in the bulk conversions branch-free
+	u32 result = sign << 15 | (u32)exponent << 10 | mantissa;
 	if (exponent < 0)
 	{
 		// Underflow: flush to zero
-		return sign << 15;
+		result = sign << 15;
 	}
-	else if (exponent > 0x1F)
+	if (exponent > 0x1F)
 	{
 		// Overflow: saturate to infinity
-		return sign << 15 | 0x1F << 10;
+		result = sign << 15 | 0x1F << 10;
 	}
 
-	return sign << 15 | exponent << 10 | mantissa;
+	return result;
+}
+
+u32 f32tof16(float f)
+{
+	return f32tof16Inline(f);
 }
 
 // f20 has:
@@ -145,7 +866,7 @@ u32 f32tof20(float f)
 //  - 1 sign bit
 //  - 7 exponent bits
 //  - 16 mantissa bits
-u32 f32tof24(float f)
+static inline u32 f32tof24Inline(float f)
 {
 	u32 i = floatrawbits(f);
 
@@ -158,18 +879,25 @@ u32 f32tof24(float f)
 
 	// Re-bias exponent
 	exponent = exponent - 127 + 63;
+
+	u32 result = sign << 23 | (u32)exponent << 16 | mantissa;
 	if (exponent < 0)
 	{
 		// Underflow: flush to zero
-		return sign << 23;
+		result = sign << 23;
 	}
-	else if (exponent > 0x7F)
+	if (exponent > 0x7F)
 	{
 		// Overflow: saturate to infinity
-		return sign << 23 | 0x7F << 16;
+		result = sign << 23 | 0x7F << 16;
 	}
 
-	return sign << 23 | exponent << 16 | mantissa;
+	return result;
+}
+
+u32 f32tof24(float f)
+{
+	return f32tof24Inline(f);
 }
 
 // f31 has:
@@ -199,3 +927,58 @@ u32 f32tof31(float f)
 
 	return sign << 30 | exponent << 23 | mantissa;
 }
+
+// The bulk conversions share the scalar code above, inlined and unrolled so that
+// the conversions of several elements can be interleaved
+void f32tof16Array(u16* restrict out, const float* restrict in, u32 count)
+{
+	u32 i;
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		u32 a = f32tof16Inline(in[i+0]);
+		u32 b = f32tof16Inline(in[i+1]);
+		u32 c = f32tof16Inline(in[i+2]);
+		u32 d = f32tof16Inline(in[i+3]);
+		out[i+0] = a;
+		out[i+1] = b;
+		out[i+2] = c;
+		out[i+3] = d;
+	}
+	for (; i < count; i ++)
+		out[i] = f32tof16Inline(in[i]);
+}
+
+void f32tof24Array(u32* restrict out, const float* restrict in, u32 count)
+{
+	u32 i;
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		u32 a = f32tof24Inline(in[i+0]);
+		u32 b = f32tof24Inline(in[i+1]);
+		u32 c = f32tof24Inline(in[i+2]);
+		u32 d = f32tof24Inline(in[i+3]);
+		out[i+0] = a;
+		out[i+1] = b;
+		out[i+2] = c;
+		out[i+3] = d;
+	}
+	for (; i < count; i ++)
+		out[i] = f32tof24Inline(in[i]);
+}
+
+// Packed f24 vectors are laid out as expected by the float uniform data ports:
+// the 4 components take 96 bits, sent as 3 words starting with the w component
+void f32tof24Vec4Packed(u32* restrict out, const float* restrict in, u32 count)
+{
+	u32 i;
+	for (i = 0; i < count; i ++, in += 4, out += 3)
+	{
+		u32 x = f32tof24Inline(in[0]);
+		u32 y = f32tof24Inline(in[1]);
+		u32 z = f32tof24Inline(in[2]);
+		u32 w = f32tof24Inline(in[3]);
+		out[0] = w << 8 | z >> 16;
+		out[1] = z << 16 | y >> 8;
+		out[2] = y << 24 | x;
+	}
+}
@@ -9,6 +9,21 @@ static void GPU_SetShaderOutmap(const u32 outmapData[8]);
 static void GPU_SendShaderCode(GPU_SHADER_TYPE type, u32* data, u16 offset, u16 length);
 static void GPU_SendOperandDescriptors(GPU_SHADER_TYPE type, u32* data, u16 offset, u16 length);
 
+// Shader code last uploaded to each shader unit, indexed by GPU_SHADER_TYPE
+typedef struct
+{
+	const DVLP_s* dvlp;
+	const u32* codeData;
+	const u32* opdescData;
+	u16 offset;
+	u16 codeSize;
+	u16 opdescSize;
+	bool valid;
+} shaderResident_s;
+
+static shaderResident_s shaderResident[2];
+static shaderUploadStats_s shaderUploadStats;
+
 Result shaderInstanceInit(shaderInstance_s* si, DVLE_s* dvle)
 {
 	if(!si || !dvle)return -1;
@@ -114,6 +129,13 @@ s8 shaderInstanceGetUniformLocation(shaderInstance_s* si, const char* name)
 	return DVLE_GetUniformRegister(si->dvle, name);
 }
 
+int shaderInstanceGetUniformLocations(shaderInstance_s* si, const char* const* names, s8* locations, int count)
+{
+	if(!si)return 0;
+
+	return DVLE_GetUniformRegisters(si->dvle, names, locations, count);
+}
+
 Result shaderProgramInit(shaderProgram_s* sp)
 {
 	if(!sp)return -1;
@@ -173,15 +195,97 @@ Result shaderProgramSetGshInputPermutation(shaderProgram_s* sp, u64 permutation)
 	return 0;
 }
 
-static inline void shaderProgramUploadDvle(const DVLE_s* dvle)
+static inline int shaderProgramCodeSize(const DVLE_s* dvle)
 {
 	const DVLP_s* dvlp = dvle->dvlp;
 	// Limit vertex shader code size to the first 512 instructions
-	int codeSize = dvle->type == GEOMETRY_SHDR ? dvlp->codeSize : (dvlp->codeSize < 512 ? dvlp->codeSize : 512);
+	return dvle->type == GEOMETRY_SHDR ? dvlp->codeSize : (dvlp->codeSize < 512 ? dvlp->codeSize : 512);
+}
+
+static inline void shaderProgramUploadDvle(const DVLE_s* dvle)
+{
+	const DVLP_s* dvlp = dvle->dvlp;
+	int codeSize = shaderProgramCodeSize(dvle);
 	GPU_SendShaderCode(dvle->type, dvlp->codeData, 0, codeSize);
 	GPU_SendOperandDescriptors(dvle->type, dvlp->opcdescData, 0, dvlp->opdescSize);
 }
 
+static void shaderProgramSetResident(GPU_SHADER_TYPE unit, const DVLE_s* dvle)
+{
+	const DVLP_s* dvlp = dvle->dvlp;
+	shaderResident_s* r = &shaderResident[unit];
+	r->dvlp       = dvlp;
+	r->codeData   = dvlp->codeData;
+	r->opdescData = dvlp->opcdescData;
+	r->offset     = 0;
+	r->codeSize   = shaderProgramCodeSize(dvle);
+	r->opdescSize = dvlp->opdescSize;
+	r->valid      = true;
+}
+
+static bool shaderProgramIsResident(GPU_SHADER_TYPE unit, const DVLE_s* dvle)
+{
+	// The data pointers and sizes are checked too, in case the DVLP was modified in place
+	const DVLP_s* dvlp = dvle->dvlp;
+	const shaderResident_s* r = &shaderResident[unit];
+	return r->valid && r->dvlp == dvlp && r->offset == 0
+		&& r->codeData == dvlp->codeData && r->codeSize == shaderProgramCodeSize(dvle)
+		&& r->opdescData == dvlp->opcdescData && r->opdescSize == dvlp->opdescSize;
+}
+
+static u32 shaderProgramWriteWords(u32 length)
+{
+	// Size of a GPUCMD_AddWrites command, including the header and padding
+	u32 words = 0;
+	if (!length) length = 1;
+	while (length)
+	{
+		u32 n = length > 0x100 ? 0x100 : length;
+		words += (n + 2) &~ 1;
+		length -= n;
+	}
+	return words;
+}
+
+static u32 shaderProgramUploadWords(const DVLE_s* dvle)
+{
+	// Mirrors the commands emitted by shaderProgramUploadDvle
+	const DVLP_s* dvlp = dvle->dvlp;
+	u32 words = 0;
+	if (dvlp->codeData)
+	{
+		int i, codeSize = shaderProgramCodeSize(dvle);
+		words += 4; // CODETRANSFER_CONFIG and CODETRANSFER_END
+		for (i = 0; i < codeSize; i += 0x80)
+			words += shaderProgramWriteWords((codeSize-i) < 0x80 ? (codeSize-i) : 0x80);
+	}
+	if (dvlp->opcdescData)
+		words += 2 + shaderProgramWriteWords(dvlp->opdescSize);
+	return words;
+}
+
+static void shaderProgramSkipUpload(const DVLE_s* dvle)
+{
+	shaderUploadStats.uploads++;
+	shaderUploadStats.words += shaderProgramUploadWords(dvle);
+}
+
+void shaderProgramInvalidateResident(const DVLP_s* dvlp)
+{
+	int i;
+	for (i = 0; i < 2; i ++)
+		if (!dvlp || shaderResident[i].dvlp == dvlp)
+			shaderResident[i].valid = false;
+}
+
+void shaderProgramGetUploadStats(shaderUploadStats_s* stats, bool reset)
+{
+	if (stats)
+		*stats = shaderUploadStats;
+	if (reset)
+		memset(&shaderUploadStats, 0, sizeof(shaderUploadStats));
+}
+
 static inline void shaderProgramMergeOutmaps(u32* outmapData, const u32* vshOutmap, const u32* gshOutmap)
 {
 	int i, j;
@@ -247,7 +351,15 @@ Result shaderProgramConfigure(shaderProgram_s* sp, bool sendVshCode, bool sendGs
 
 	// Set up vertex shader code blob (if necessary)
 	if (sendVshCode)
+	{
 		shaderProgramUploadDvle(vshDvle);
+		shaderProgramSetResident(GPU_VERTEX_SHADER, vshDvle);
+
+		// Without a geometry shader, the geometry unit runs as a fourth vertex unit
+		// and receives a copy of everything written to the vertex shader registers
+		if (!gshDvle)
+			shaderProgramSetResident(GPU_GEOMETRY_SHADER, vshDvle);
+	}
 
 	// Set up vertex shader entrypoint & outmap mask
 	GPUCMD_AddWrite(GPUREG_VSH_ENTRYPOINT, 0x7FFF0000|(vshDvle->mainOffset&0xFFFF));
@@ -260,7 +372,10 @@ Result shaderProgramConfigure(shaderProgram_s* sp, bool sendVshCode, bool sendGs
 	{
 		// Set up geometry shader code blob (if necessary)
 		if (sendGshCode)
+		{
 			shaderProgramUploadDvle(gshDvle);
+			shaderProgramSetResident(GPU_GEOMETRY_SHADER, gshDvle);
+		}
 
 		// Set up geometry shader entrypoint & outmap mask
 		GPUCMD_AddWrite(GPUREG_GSH_ENTRYPOINT, 0x7FFF0000|(gshDvle->mainOffset&0xFFFF));
@@ -323,7 +438,23 @@ Result shaderProgramConfigure(shaderProgram_s* sp, bool sendVshCode, bool sendGs
 
 Result shaderProgramUse(shaderProgram_s* sp)
 {
-	Result rc = shaderProgramConfigure(sp, true, true);
+	if (!sp || !sp->vertexShader) return -1;
+
+	const DVLE_s* vshDvle = sp->vertexShader->dvle;
+	const DVLE_s* gshDvle = sp->geometryShader ? sp->geometryShader->dvle : NULL;
+
+	// Skip code uploads for shaders that are already resident. When the geometry unit
+	// runs as a vertex unit, it needs to hold the vertex shader as well.
+	bool sendVshCode = !shaderProgramIsResident(GPU_VERTEX_SHADER, vshDvle)
+		|| (!gshDvle && !shaderProgramIsResident(GPU_GEOMETRY_SHADER, vshDvle));
+	bool sendGshCode = gshDvle && !shaderProgramIsResident(GPU_GEOMETRY_SHADER, gshDvle);
+
+	if (!sendVshCode)
+		shaderProgramSkipUpload(vshDvle);
+	if (gshDvle && !sendGshCode)
+		shaderProgramSkipUpload(gshDvle);
+
+	Result rc = shaderProgramConfigure(sp, sendVshCode, sendGshCode);
 	if (R_FAILED(rc)) return rc;
 
 	int i;
@@ -7,6 +7,51 @@
 #include <3ds/types.h>
 #include <3ds/gpu/gpu.h>
 #include <3ds/gpu/shbin.h>
+#include <3ds/gpu/shaderProgram.h>
+
+// Uniform hash index entries hold the uniform index plus one in the low half (0 = empty slot),
+// and the top bits of the name hash in the high half to skip most string compares
+static u32 DVLE_HashName(const char* name)
+{
+	u32 h=2166136261u;
+	while(*name)h=(h^(u8)*name++)*16777619u;
+	return h;
+}
+
+static void DVLE_BuildUniformHash(DVLE_s* dvle)
+{
+	dvle->uniformHash=NULL;
+	dvle->uniformHashMask=0;
+	if(!dvle->uniformTableSize || dvle->uniformTableSize>=0xFFFF)return;
+
+	// Keep the load factor at or below 1/2
+	u32 size=4;
+	while(size<dvle->uniformTableSize*2)size<<=1;
+	u32* hash=calloc(size, sizeof(u32));
+	if(!hash)return; // Lookups fall back to scanning the uniform table
+
+	int i; DVLE_uniformEntry_s* u=dvle->uniformTableData;
+	for(i=0;i<dvle->uniformTableSize;i++)
+	{
+		const char* name=&dvle->symbolTableData[u[i].symbolOffset];
+		u32 h=DVLE_HashName(name);
+		u32 slot=h&(size-1);
+		for(;;slot=(slot+1)&(size-1))
+		{
+			u32 e=hash[slot];
+			if(!e)
+			{
+				hash[slot]=(h&0xFFFF0000)|(i+1);
+				break;
+			}
+			// Keep the first entry for duplicate names, like the table scan does
+			if((e&0xFFFF0000)==(h&0xFFFF0000) && !strcmp(&dvle->symbolTableData[u[(e&0xFFFF)-1].symbolOffset],name))break;
+		}
+	}
+
+	dvle->uniformHash=hash;
+	dvle->uniformHashMask=size-1;
+}
 
 //please don't feed this an invalid SHBIN
 DVLB_s* DVLB_ParseFile(u32* shbinData, u32 shbinSize)
@@ -62,6 +107,7 @@ DVLB_s* DVLB_ParseFile(u32* shbinData, u32 shbinSize)
 		dvle->symbolTableData=(char*)&dvleData[dvleData[14]/4];
 
 		DVLE_GenerateOutmap(dvle);
+		DVLE_BuildUniformHash(dvle);
 	}
 
 	goto exit;
@@ -78,8 +124,13 @@ DVLB_s* DVLB_ParseFile(u32* shbinData, u32 shbinSize)
 void DVLB_Free(DVLB_s* dvlb)
 {
 	if(!dvlb)return;
+	shaderProgramInvalidateResident(&dvlb->DVLP);
 	if(dvlb->DVLP.opcdescData)free(dvlb->DVLP.opcdescData);
-	if(dvlb->DVLE)free(dvlb->DVLE);
+	if(dvlb->DVLE)
+	{
+		int i; for(i=0;i<dvlb->numDVLE;i++)free(dvlb->DVLE[i].uniformHash);
+		free(dvlb->DVLE);
+	}
 	free(dvlb);
 }
 
@@ -87,7 +138,25 @@ s8 DVLE_GetUniformRegister(DVLE_s* dvle, const char* name)
 {
 	if(!dvle || !name)return -1;
 
-	int i;	DVLE_uniformEntry_s* u=dvle->uniformTableData;
+	DVLE_uniformEntry_s* u=dvle->uniformTableData;
+	if(dvle->uniformHash)
+	{
+		u32 h=DVLE_HashName(name);
+		u32 slot=h&dvle->uniformHashMask;
+		u32 e;
+		while((e=dvle->uniformHash[slot]))
+		{
+			if((e&0xFFFF0000)==(h&0xFFFF0000))
+			{
+				DVLE_uniformEntry_s* cur=&u[(e&0xFFFF)-1];
+				if(!strcmp(&dvle->symbolTableData[cur->symbolOffset],name))return (s8)cur->startReg-0x10;
+			}
+			slot=(slot+1)&dvle->uniformHashMask;
+		}
+		return -1;
+	}
+
+	int i;
 	for(i=0;i<dvle->uniformTableSize;i++)
 	{
 		if(!strcmp(&dvle->symbolTableData[u->symbolOffset],name))return (s8)u->startReg-0x10;
@@ -96,6 +165,19 @@ s8 DVLE_GetUniformRegister(DVLE_s* dvle, const char* name)
 	return -1;
 }
 
+int DVLE_GetUniformRegisters(DVLE_s* dvle, const char* const* names, s8* regs, int count)
+{
+	if(!dvle || !names || !regs)return 0;
+
+	int i, found=0;
+	for(i=0;i<count;i++)
+	{
+		regs[i]=DVLE_GetUniformRegister(dvle, names[i]);
+		if(regs[i]>=0)found++;
+	}
+	return found;
+}
+
 void DVLE_GenerateOutmap(DVLE_s* dvle)
 {
 	if (!dvle) return;
@@ -55,6 +55,9 @@ static inline ThreadVars* getThreadVars(void)
 
 void initThreadVars(struct Thread_tag *thread);
 
+// Returns the calling thread's linear allocator runs to the shared pool
+void __linear_thread_exit(void);
+
 static inline size_t alignTo(const size_t base, const size_t align) {
 	return (base + (align - 1)) & ~(align - 1);
 }
@@ -0,0 +1,227 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <3ds/types.h>
+#include <3ds/result.h>
+#include <3ds/synchronization.h>
+#include <3ds/thread.h>
+#include <3ds/prefetch.h>
+
+#define PREFETCH_STACK_SIZE 0x2000
+#define PREFETCH_MAX_THREADS 8
+
+static LightLock prefetchInitLock = 1;
+static int prefetchRefCount;
+static Thread prefetchThreads[PREFETCH_MAX_THREADS];
+static u32 prefetchThreadCount;
+
+static LightLock prefetchLock = 1;
+static LightSemaphore prefetchSem;
+static LightLock prefetchDoneLock = 1;
+static CondVar prefetchDoneCond;
+static prefetchRequest *prefetchHead, *prefetchTail;
+static u32 prefetchPending;
+static bool prefetchRunning;
+
+static void prefetchRead(prefetchRequest* req)
+{
+	req->result = -1;
+	req->error  = 0;
+
+	int fd = open(req->path, O_RDONLY);
+	if (fd < 0)
+	{
+		req->error = errno;
+		return;
+	}
+
+	if (req->offset && lseek(fd, (off_t)req->offset, SEEK_SET) < 0)
+	{
+		req->error = errno;
+		close(fd);
+		return;
+	}
+
+	// Devices may return short reads, keep going until the end of the file
+	size_t total = 0;
+	while (total < req->size)
+	{
+		ssize_t got = read(fd, (u8*)req->buffer + total, req->size - total);
+		if (got < 0)
+		{
+			req->error = errno;
+			close(fd);
+			return;
+		}
+		if (!got)
+			break;
+		total += got;
+	}
+
+	close(fd);
+	req->result = total;
+}
+
+static void prefetchComplete(prefetchRequest* req)
+{
+	if (req->callback)
+		req->callback(req);
+
+	// The request may be reused as soon as it is marked done. Marking it under
+	// the lock makes sure waiters can't miss the wakeup.
+	LightEvent* event = req->event;
+	LightLock_Lock(&prefetchDoneLock);
+	__atomic_store_n(&req->done, true, __ATOMIC_RELEASE);
+	CondVar_Broadcast(&prefetchDoneCond);
+	LightLock_Unlock(&prefetchDoneLock);
+	if (event)
+		LightEvent_Signal(event);
+}
+
+static void prefetchThreadMain(void* arg)
+{
+	for (;;)
+	{
+		LightSemaphore_Acquire(&prefetchSem, 1);
+
+		LightLock_Lock(&prefetchLock);
+		prefetchRequest* req = prefetchHead;
+		if (req)
+		{
+			prefetchHead = req->next;
+			if (!prefetchHead)
+				prefetchTail = NULL;
+			prefetchPending--;
+		}
+		LightLock_Unlock(&prefetchLock);
+
+		// An empty queue means we are being asked to stop
+		if (!req)
+			break;
+
+		prefetchRead(req);
+		prefetchComplete(req);
+	}
+}
+
+Result prefetchInit(u32 threadCount, int prio)
+{
+	LightLock_Lock(&prefetchInitLock);
+	if (prefetchRefCount)
+	{
+		prefetchRefCount++;
+		LightLock_Unlock(&prefetchInitLock);
+		return 0;
+	}
+
+	if (!threadCount)
+		threadCount = PREFETCH_DEFAULT_THREADS;
+	if (threadCount > PREFETCH_MAX_THREADS)
+		threadCount = PREFETCH_MAX_THREADS;
+
+	LightSemaphore_Init(&prefetchSem, 0, 0x7FFF);
+	prefetchHead = prefetchTail = NULL;
+	prefetchPending = 0;
+
+	for (prefetchThreadCount = 0; prefetchThreadCount < threadCount; prefetchThreadCount++)
+	{
+		Thread t = threadCreate(prefetchThreadMain, NULL, PREFETCH_STACK_SIZE, prio, -2, false);
+		if (!t)
+			break;
+		prefetchThreads[prefetchThreadCount] = t;
+	}
+
+	if (!prefetchThreadCount)
+	{
+		LightLock_Unlock(&prefetchInitLock);
+		return MAKERESULT(RL_FATAL, RS_OUTOFRESOURCE, RM_APPLICATION, RD_OUT_OF_MEMORY);
+	}
+
+	// Only accept requests and count the reference once the workers are running
+	LightLock_Lock(&prefetchLock);
+	prefetchRunning = true;
+	LightLock_Unlock(&prefetchLock);
+	prefetchRefCount = 1;
+	LightLock_Unlock(&prefetchInitLock);
+	return 0;
+}
+
+void prefetchExit(void)
+{
+	LightLock_Lock(&prefetchInitLock);
+	if (!prefetchRefCount || --prefetchRefCount)
+	{
+		LightLock_Unlock(&prefetchInitLock);
+		return;
+	}
+
+	// Refuse new requests first. Anything already queued still gets its
+	// semaphore count, and workers drain the queue before they see the stop
+	// requests.
+	LightLock_Lock(&prefetchLock);
+	prefetchRunning = false;
+	LightLock_Unlock(&prefetchLock);
+	LightSemaphore_Release(&prefetchSem, prefetchThreadCount);
+	for (u32 i = 0; i < prefetchThreadCount; i ++)
+	{
+		threadJoin(prefetchThreads[i], U64_MAX);
+		threadFree(prefetchThreads[i]);
+		prefetchThreads[i] = NULL;
+	}
+	prefetchThreadCount = 0;
+	LightLock_Unlock(&prefetchInitLock);
+}
+
+Result prefetchSubmit(prefetchRequest* reqs, size_t count)
+{
+	if (!count)
+		return 0;
+	if (!reqs)
+		return MAKERESULT(RL_USAGE, RS_INVALIDARG, RM_APPLICATION, RD_INVALID_POINTER);
+
+	for (size_t i = 0; i < count; i ++)
+	{
+		reqs[i].result = 0;
+		reqs[i].error  = 0;
+		reqs[i].done   = false;
+		reqs[i].next   = i+1 < count ? &reqs[i+1] : NULL;
+	}
+
+	LightLock_Lock(&prefetchLock);
+	if (!prefetchRunning)
+	{
+		LightLock_Unlock(&prefetchLock);
+		return MAKERESULT(RL_USAGE, RS_INVALIDSTATE, RM_APPLICATION, RD_NOT_INITIALIZED);
+	}
+
+	if (count > PREFETCH_MAX_PENDING - prefetchPending)
+	{
+		LightLock_Unlock(&prefetchLock);
+		return MAKERESULT(RL_USAGE, RS_OUTOFRESOURCE, RM_APPLICATION, RD_OUT_OF_RANGE);
+	}
+
+	if (prefetchTail)
+		prefetchTail->next = reqs;
+	else
+		prefetchHead = reqs;
+	prefetchTail = &reqs[count-1];
+	prefetchPending += count;
+	LightLock_Unlock(&prefetchLock);
+
+	LightSemaphore_Release(&prefetchSem, count);
+	return 0;
+}
+
+ssize_t prefetchWait(prefetchRequest* req)
+{
+	if (!prefetchIsDone(req))
+	{
+		LightLock_Lock(&prefetchDoneLock);
+		while (!prefetchIsDone(req))
+			CondVar_Wait(&prefetchDoneCond, &prefetchDoneLock);
+		LightLock_Unlock(&prefetchDoneLock);
+	}
+
+	return req->result;
+}
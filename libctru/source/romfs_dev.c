@@ -11,39 +11,108 @@
 #include <3ds/types.h>
 #include <3ds/result.h>
 #include <3ds/svc.h>
+#include <3ds/synchronization.h>
 #include <3ds/romfs.h>
 #include <3ds/services/fs.h>
 #include <3ds/util/utf.h>
 #include <3ds/env.h>
+#include <3ds/allocator/linear.h>
 
 #include "path_buf.h"
 
+typedef struct romfs_block
+{
+	struct romfs_block *prev, *next; // LRU order, most recently used first
+	u64                index;        // Block number within the image
+	u32                size;         // Number of valid bytes
+	u8                 *data;
+} romfs_block;
+
+typedef struct
+{
+	LightLock   lock;
+	u32         blockShift;
+	u32         blockCount;
+	u32         readAhead;
+	bool        cacheByDefault;
+	romfs_block *blocks;
+	romfs_block *mru, *lru;
+	u8          *data;    // Block storage
+	u8          *scratch; // Staging area for read-ahead
+} romfs_cache;
+
+typedef struct
+{
+	u32 hash;
+	u32 pathOff; // Offset of the path in the path pool
+	u32 entry;   // Table offset, with romFS_index_dir set for directories
+} romfs_index_slot;
+
+typedef struct
+{
+	u32              mask;
+	romfs_index_slot *slots;
+	char             *paths; // Full paths relative to the root, NUL-terminated
+} romfs_index;
+
 typedef struct romfs_mount
 {
 	devoptab_t         device;
 	char               name[32];
 	Handle             fd;
+	const u8           *image; // In-memory image, if not backed by a file
+	size_t             imageSize;
 	time_t             mtime;
 	u32                offset;
+	u32                flags;  // ROMFS_MOUNT_* flags
 	romfs_header       header;
-	romfs_dir          *cwd;
+	u32                cwd;    // Offset of the current directory
 	u32                *dirHashTable, *fileHashTable;
 	void               *dirTable, *fileTable;
+	romfs_cache        cache;
+	romfs_index        index;
 	struct romfs_mount *next;
 } romfs_mount;
 
 extern int __system_argc;
 extern char** __system_argv;
 
-#define romFS_root(m)   ((romfs_dir*)(m)->dirTable)
+#define romFS_root      ((u32)0)
 #define romFS_dir(m,x)  ((romfs_dir*) ((u8*)(m)->dirTable  + (x)))
 #define romFS_file(m,x) ((romfs_file*)((u8*)(m)->fileTable + (x)))
+#define romFS_lazy(m)   ((m)->flags & ROMFS_MOUNT_LAZY)
 #define romFS_none      ((u32)~0)
+#define romFS_index_dir (1U << 31)
 #define romFS_dir_mode  (S_IFDIR | S_IRUSR | S_IRGRP | S_IROTH)
 #define romFS_file_mode (S_IFREG | S_IRUSR | S_IRGRP | S_IROTH)
 
+// Read cache given to lazily loaded mounts, until configured otherwise
+#define romFS_lazy_block_size 0x1000
+#define romFS_lazy_budget     0x10000
+
+// Entries of lazily loaded mounts are copied out of the image. Only the first
+// NAME_MAX units of a name are kept, so longer names never match a lookup.
+typedef union
+{
+	romfs_dir  dir;
+	romfs_file file;
+	u8         raw[sizeof(romfs_file) + NAME_MAX*2];
+} romfs_entry;
+
+#define romFS_name_fits(m,len) (!romFS_lazy(m) || (len) <= NAME_MAX*2)
+
 static ssize_t _romfs_read(romfs_mount *mount, u64 offset, void* buffer, u32 size)
 {
+	if (mount->image)
+	{
+		if (offset >= mount->imageSize)
+			return 0;
+		if (size > mount->imageSize - offset)
+			size = mount->imageSize - offset;
+		memcpy(buffer, mount->image + offset, size);
+		return size;
+	}
+
 	u64 pos = (u64)mount->offset + offset;
 	u32 read = 0;
 	Result rc = FSFILE_Read(mount->fd, &read, pos, buffer, size);
@@ -73,14 +142,17 @@ static int       romfs_dirclose(struct _reent *r, DIR_ITER *dirState);
 typedef struct
 {
 	romfs_mount *mount;
-	romfs_file  *file;
-	u64         offset, pos;
+	u32         entry; // Offset of the file entry
+	u64         offset, size, pos;
+	bool        cached;
+	u64         nextBlock; // Block following the last one read, to detect sequential access
 } romfs_fileobj;
 
 typedef struct
 {
 	romfs_mount *mount;
-	romfs_dir* dir;
+	u32        dir, parent;
+	u32        firstDir, firstFile;
 	u32        state;
 	u32        childDir;
 	u32        childFile;
@@ -127,6 +199,7 @@ typedef struct
 __attribute__((weak)) const char* __romfs_path = NULL;
 
 static romfs_mount *romfs_mount_list = NULL;
+static u32 romfs_mount_flags = 0;
 
 static void romfs_insert(romfs_mount *mount)
 {
@@ -156,23 +229,144 @@ static romfs_mount* romfs_alloc(void)
 		memcpy(&mount->device, &romFS_devoptab, sizeof(romFS_devoptab));
 		mount->device.name = mount->name;
 		mount->device.deviceData = mount;
+		LightLock_Init(&mount->cache.lock);
 		romfs_insert(mount);
 	}
 
 	return mount;
 }
 
+static void romfs_cache_free(romfs_cache *cache)
+{
+	free(cache->blocks);
+	free(cache->data);
+	free(cache->scratch);
+	cache->blocks     = NULL;
+	cache->data       = NULL;
+	cache->scratch    = NULL;
+	cache->mru        = NULL;
+	cache->lru        = NULL;
+	cache->blockCount = 0;
+}
+
+static bool romfs_in_image(romfs_mount *mount, const void *ptr)
+{
+	return mount->image && (const u8*)ptr >= mount->image && (const u8*)ptr < mount->image + mount->imageSize;
+}
+
+static void romfs_free_table(romfs_mount *mount, void *table)
+{
+	if (!table || romfs_in_image(mount, table))
+		return;
+	if (mount->flags & ROMFS_MOUNT_LINEAR)
+		linearFree(table);
+	else
+		free(table);
+}
+
+static void romfs_index_free(romfs_index *index)
+{
+	free(index->slots);
+	free(index->paths);
+	index->slots = NULL;
+	index->paths = NULL;
+	index->mask  = 0;
+}
+
 static void romfs_free(romfs_mount *mount)
 {
-	FSFILE_Close(mount->fd);
+	if (!mount->image)
+		FSFILE_Close(mount->fd);
 	romfs_remove(mount);
-	free(mount->fileTable);
-	free(mount->fileHashTable);
-	free(mount->dirTable);
-	free(mount->dirHashTable);
+	romfs_cache_free(&mount->cache);
+	romfs_index_free(&mount->index);
+	romfs_free_table(mount, mount->fileTable);
+	romfs_free_table(mount, mount->fileHashTable);
+	romfs_free_table(mount, mount->dirTable);
+	romfs_free_table(mount, mount->dirHashTable);
 	free(mount);
 }
 
+static void* romfs_load_table(romfs_mount *mount, u32 offset, u32 size, Result *rc)
+{
+	if (mount->image)
+	{
+		if (offset > mount->imageSize || size > mount->imageSize - offset)
+		{
+			*rc = MAKERESULT(RL_FATAL, RS_INVALIDSTATE, RM_ROMFS, RD_NOT_FOUND);
+			return NULL;
+		}
+
+		// Tables in a suitably aligned image can be used where they are
+		if (size && !(((uintptr_t)mount->image + offset) & 3))
+			return (void*)(mount->image + offset);
+	}
+
+	void *table = (mount->flags & ROMFS_MOUNT_LINEAR) ? linearAlloc(size) : malloc(size);
+	if (!table)
+	{
+		*rc = MAKERESULT(RL_FATAL, RS_OUTOFRESOURCE, RM_ROMFS, RD_OUT_OF_MEMORY);
+		return NULL;
+	}
+
+	if (!_romfs_read_chk(mount, offset, table, size))
+	{
+		romfs_free_table(mount, table);
+		*rc = MAKERESULT(RL_FATAL, RS_INVALIDSTATE, RM_ROMFS, RD_NOT_FOUND);
+		return NULL;
+	}
+
+	return table;
+}
+
+static Result romfs_cache_setup(romfs_mount *mount, const romfs_cache_config *config);
+
+// Loads the metadata of a freshly allocated mount and registers its device.
+// The mount is freed on failure.
+static Result romfs_setup(romfs_mount *mount, const char *name)
+{
+	Result rc = MAKERESULT(RL_FATAL, RS_INVALIDSTATE, RM_ROMFS, RD_NOT_FOUND);
+
+	mount->mtime = time(NULL);
+	strncpy(mount->name, name, sizeof(mount->name)-1);
+
+	if (_romfs_read(mount, 0, &mount->header, sizeof(mount->header)) != sizeof(mount->header))
+		goto fail;
+
+	if (romFS_lazy(mount))
+	{
+		// Entries are paged in through the read cache as they are looked up
+		romfs_cache_config config = { romFS_lazy_block_size, romFS_lazy_budget, 0, false };
+		if (R_FAILED(rc = romfs_cache_setup(mount, &config)))
+			goto fail;
+	}
+	else
+	{
+		if (!(mount->dirHashTable = (u32*)romfs_load_table(mount, mount->header.dirHashTableOff, mount->header.dirHashTableSize, &rc)))
+			goto fail;
+		if (!(mount->dirTable = romfs_load_table(mount, mount->header.dirTableOff, mount->header.dirTableSize, &rc)))
+			goto fail;
+		if (!(mount->fileHashTable = (u32*)romfs_load_table(mount, mount->header.fileHashTableOff, mount->header.fileHashTableSize, &rc)))
+			goto fail;
+		if (!(mount->fileTable = romfs_load_table(mount, mount->header.fileTableOff, mount->header.fileTableSize, &rc)))
+			goto fail;
+	}
+
+	mount->cwd = romFS_root;
+
+	if (AddDevice(&mount->device) < 0)
+	{
+		rc = MAKERESULT(RL_FATAL, RS_OUTOFRESOURCE, RM_ROMFS, RD_OUT_OF_MEMORY);
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	romfs_free(mount);
+	return rc;
+}
+
 Result romfsMountFromFile(Handle fd, u32 offset, const char *name)
 {
 	romfs_mount *mount = romfs_alloc();
@@ -184,50 +378,28 @@ Result romfsMountFromFile(Handle fd, u32 offset, const char *name)
 
 	mount->fd     = fd;
 	mount->offset = offset;
-	mount->mtime  = time(NULL);
-	strncpy(mount->name, name, sizeof(mount->name)-1);
-
-	if (_romfs_read(mount, 0, &mount->header, sizeof(mount->header)) != sizeof(mount->header))
-		goto fail_io;
-
-	mount->dirHashTable = (u32*)malloc(mount->header.dirHashTableSize);
-	if (!mount->dirHashTable)
-		goto fail_oom;
-	if (!_romfs_read_chk(mount, mount->header.dirHashTableOff, mount->dirHashTable, mount->header.dirHashTableSize))
-		goto fail_io;
-
-	mount->dirTable = malloc(mount->header.dirTableSize);
-	if (!mount->dirTable)
-		goto fail_oom;
-	if (!_romfs_read_chk(mount, mount->header.dirTableOff, mount->dirTable, mount->header.dirTableSize))
-		goto fail_io;
-
-	mount->fileHashTable = (u32*)malloc(mount->header.fileHashTableSize);
-	if (!mount->fileHashTable)
-		goto fail_oom;
-	if (!_romfs_read_chk(mount, mount->header.fileHashTableOff, mount->fileHashTable, mount->header.fileHashTableSize))
-		goto fail_io;
-
-	mount->fileTable = malloc(mount->header.fileTableSize);
-	if (!mount->fileTable)
-		goto fail_oom;
-	if (!_romfs_read_chk(mount, mount->header.fileTableOff, mount->fileTable, mount->header.fileTableSize))
-		goto fail_io;
-
-	mount->cwd = romFS_root(mount);
+	mount->flags  = romfs_mount_flags;
+	return romfs_setup(mount, name);
+}
 
-	if (AddDevice(&mount->device) < 0)
-		goto fail_oom;
+Result romfsMountFromMemory(const void *image, size_t size, const char *name)
+{
+	if (!image || size < sizeof(romfs_header))
+		return MAKERESULT(RL_USAGE, RS_INVALIDARG, RM_ROMFS, RD_INVALID_SIZE);
 
-	return 0;
+	romfs_mount *mount = romfs_alloc();
+	if (mount == NULL)
+		return MAKERESULT(RL_FATAL, RS_OUTOFRESOURCE, RM_ROMFS, RD_OUT_OF_MEMORY);
 
-fail_oom:
-	romfs_free(mount);
-	return MAKERESULT(RL_FATAL, RS_OUTOFRESOURCE, RM_ROMFS, RD_OUT_OF_MEMORY);
+	mount->image     = (const u8*)image;
+	mount->imageSize = size;
+	mount->flags     = romfs_mount_flags &~ ROMFS_MOUNT_LAZY;
+	return romfs_setup(mount, name);
+}
 
-fail_io:
-	romfs_free(mount);
-	return MAKERESULT(RL_FATAL, RS_INVALIDSTATE, RM_ROMFS, RD_NOT_FOUND);
+void romfsSetMountFlags(u32 flags)
+{
+	romfs_mount_flags = flags;
 }
 
 Result romfsMountSelf(const char* name)
@@ -325,9 +497,8 @@ Result romfsMountFromTitle(u64 tid, FS_MediaType mediatype, const char* name)
 	return rc;
 }
 
-Result romfsUnmount(const char* name)
+static romfs_mount* romfs_find(const char* name)
 {
-	// Find the mount
 	romfs_mount* mount = romfs_mount_list;
 	while (mount)
 	{
@@ -335,7 +506,13 @@ Result romfsUnmount(const char* name)
 			break;
 		mount = mount->next;
 	}
+	return mount;
+}
 
+Result romfsUnmount(const char* name)
+{
+	// Find the mount
+	romfs_mount* mount = romfs_find(name);
 	if (mount == NULL)
 		return MAKERESULT(RL_STATUS, RS_NOTFOUND, RM_ROMFS, RD_NOT_FOUND);
 
@@ -355,6 +532,280 @@ Result romfsUnmount(const char* name)
 
 //-----------------------------------------------------------------------------
 
+static Result romfs_cache_setup(romfs_mount *mount, const romfs_cache_config *config)
+{
+	u32 blockSize = config ? config->blockSize : 0;
+	u32 budget    = config ? config->budget    : 0;
+	u32 readAhead = config ? config->readAhead : 0;
+	if (budget && (blockSize < 0x200 || (blockSize & (blockSize-1))))
+		return MAKERESULT(RL_USAGE, RS_INVALIDARG, RM_ROMFS, RD_INVALID_SIZE);
+
+	// The read-ahead staging area comes out of the budget, and can't be
+	// larger than the cache itself
+	u32 blockCount = budget ? budget / blockSize : 0;
+	if (readAhead >= blockCount / 2)
+		readAhead = blockCount / 2 > 1 ? blockCount / 2 - 1 : 0;
+	if (readAhead)
+		blockCount -= readAhead + 1;
+
+	romfs_cache *cache = &mount->cache;
+	LightLock_Lock(&cache->lock);
+	romfs_cache_free(cache);
+
+	// In-memory images have nothing to gain from a cache
+	Result rc = 0;
+	if (budget && blockCount && !mount->image)
+	{
+		cache->blocks  = (romfs_block*)malloc(blockCount * sizeof(romfs_block));
+		cache->data    = (u8*)malloc(blockCount * blockSize);
+		cache->scratch = readAhead ? (u8*)malloc((readAhead + 1) * blockSize) : NULL;
+		if (!cache->blocks || !cache->data || (readAhead && !cache->scratch))
+		{
+			romfs_cache_free(cache);
+			rc = MAKERESULT(RL_FATAL, RS_OUTOFRESOURCE, RM_ROMFS, RD_OUT_OF_MEMORY);
+		}
+		else
+		{
+			cache->blockShift = __builtin_ctz(blockSize);
+			cache->blockCount = blockCount;
+			cache->readAhead  = readAhead;
+			for (u32 i = 0; i < blockCount; i ++)
+			{
+				romfs_block *block = &cache->blocks[i];
+				block->prev  = i > 0 ? &cache->blocks[i-1] : NULL;
+				block->next  = i+1 < blockCount ? &cache->blocks[i+1] : NULL;
+				block->index = ~(u64)0;
+				block->size  = 0;
+				block->data  = cache->data + (i << cache->blockShift);
+			}
+			cache->mru = &cache->blocks[0];
+			cache->lru = &cache->blocks[blockCount-1];
+		}
+	}
+
+	cache->cacheByDefault = config && config->cacheByDefault && cache->blockCount;
+	LightLock_Unlock(&cache->lock);
+	return rc;
+}
+
+Result romfsSetCache(const char *name, const romfs_cache_config *config)
+{
+	romfs_mount* mount = romfs_find(name);
+	if (mount == NULL)
+		return MAKERESULT(RL_STATUS, RS_NOTFOUND, RM_ROMFS, RD_NOT_FOUND);
+
+	return romfs_cache_setup(mount, config);
+}
+
+Result romfsSetFileCaching(int fd, bool enable)
+{
+	__handle *handle = __get_handle(fd);
+	if (handle == NULL || devoptab_list[handle->device]->open_r != romfs_open)
+		return MAKERESULT(RL_USAGE, RS_INVALIDARG, RM_ROMFS, RD_INVALID_HANDLE);
+
+	romfs_fileobj* file = (romfs_fileobj*)handle->fileStruct;
+	file->cached = enable;
+	return 0;
+}
+
+static void romfs_cache_touch(romfs_cache *cache, romfs_block *block)
+{
+	if (block == cache->mru)
+		return;
+
+	// Unlink, then put it in front
+	block->prev->next = block->next;
+	if (block->next) block->next->prev = block->prev;
+	else             cache->lru = block->prev;
+
+	block->prev = NULL;
+	block->next = cache->mru;
+	cache->mru->prev = block;
+	cache->mru = block;
+}
+
+// Must be called with the cache lock held
+static romfs_block* romfs_cache_fill(romfs_mount *mount, u64 index, u32 count)
+{
+	romfs_cache *cache = &mount->cache;
+	u32 blockSize = 1U << cache->blockShift;
+
+	// Fetch all blocks with a single request
+	u8 *buf = count > 1 ? cache->scratch : cache->lru->data;
+	if (buf == cache->lru->data)
+	{
+		// The read clobbers the block, so it must not stay findable if it fails
+		cache->lru->index = ~(u64)0;
+		cache->lru->size = 0;
+	}
+	ssize_t got = _romfs_read(mount, index << cache->blockShift, buf, count << cache->blockShift);
+	if (got < 0)
+		return NULL;
+
+	romfs_block *first = NULL, *last = NULL;
+	for (u32 i = 0; i < count; i ++)
+	{
+		u32 size = got > blockSize ? blockSize : got;
+		if (!size && first)
+			break;
+
+		romfs_block *block = cache->lru;
+		if (buf != block->data)
+			memcpy(block->data, buf + (i << cache->blockShift), size);
+		block->index = index + i;
+		block->size  = size;
+		got -= size;
+
+		if (!first)
+		{
+			first = block;
+			romfs_cache_touch(cache, block);
+		}
+		else
+		{
+			// Read-ahead blocks go just behind the requested one, in order
+			block->prev->next = NULL;
+			cache->lru = block->prev;
+			block->prev = last;
+			block->next = last->next;
+			if (last->next) last->next->prev = block;
+			else            cache->lru = block;
+			last->next = block;
+		}
+		last = block;
+	}
+
+	return first;
+}
+
+static ssize_t romfs_cache_read(romfs_mount *mount, u64 *nextBlock, u64 offset, void *buffer, size_t len)
+{
+	romfs_cache *cache = &mount->cache;
+	u8 *out = (u8*)buffer;
+	size_t total = 0;
+
+	while (len)
+	{
+		LightLock_Lock(&cache->lock);
+		if (!cache->blockCount)
+		{
+			// The cache was disabled behind our back
+			LightLock_Unlock(&cache->lock);
+			ssize_t got = _romfs_read(mount, offset, out, len);
+			if (got < 0)
+				return total ? (ssize_t)total : -1;
+			return total + got;
+		}
+
+		u32 shift = cache->blockShift;
+		u64 index = offset >> shift;
+		u32 inBlock = offset & ((1U << shift) - 1);
+
+		// Large aligned spans gain nothing from the cache, read them directly
+		if (!inBlock && (len >> shift))
+		{
+			LightLock_Unlock(&cache->lock);
+			size_t span = (len >> shift) << shift;
+			ssize_t got = _romfs_read(mount, offset, out, span);
+			if (got < 0)
+				return total ? (ssize_t)total : -1;
+			*nextBlock = (offset + got) >> shift;
+			offset += got;
+			out    += got;
+			len    -= got;
+			total  += got;
+			if ((size_t)got < span)
+				break;
+			continue;
+		}
+
+		romfs_block *block;
+		for (block = cache->mru; block && block->index != index; block = block->next);
+		if (block)
+			romfs_cache_touch(cache, block);
+		else
+		{
+			u32 count = index == *nextBlock ? cache->readAhead + 1 : 1;
+			block = romfs_cache_fill(mount, index, count);
+			if (!block)
+			{
+				LightLock_Unlock(&cache->lock);
+				return total ? (ssize_t)total : -1;
+			}
+		}
+		*nextBlock = index + 1;
+
+		// Stop at the end of the image
+		u32 size = block->size > inBlock ? block->size - inBlock : 0;
+		if (size > len)
+			size = len;
+		memcpy(out, block->data + inBlock, size);
+		LightLock_Unlock(&cache->lock);
+
+		if (!size)
+			break;
+		offset += size;
+		out    += size;
+		len    -= size;
+		total  += size;
+	}
+
+	return total;
+}
+
+//-----------------------------------------------------------------------------
+
+static bool romfs_meta_read(romfs_mount *mount, u64 offset, void *buffer, u32 size)
+{
+	// Lookups jump around the tables, so read-ahead would only get in the way
+	u64 nextBlock = ~(u64)0;
+	return romfs_cache_read(mount, &nextBlock, offset, buffer, size) == size;
+}
+
+static bool romfs_get_bucket(romfs_mount *mount, const u32 *table, u32 tableOff, u32 hash, u32 *out)
+{
+	if (!romFS_lazy(mount))
+	{
+		*out = table[hash];
+		return true;
+	}
+	return romfs_meta_read(mount, (u64)tableOff + hash*4, out, sizeof(*out));
+}
+
+static bool romfs_load_entry(romfs_mount *mount, u32 tableOff, u32 tableSize, u32 off, u32 headSize, romfs_entry *buf)
+{
+	// Fetch the header and as much of the name as fits in one go
+	u32 size = off < tableSize ? tableSize - off : 0;
+	if (size > sizeof(buf->raw))
+		size = sizeof(buf->raw);
+	if (size < headSize || !romfs_meta_read(mount, (u64)tableOff + off, buf->raw, size))
+		return false;
+
+	// nameLen is the last header field of both entry types
+	u32 nameLen = *(u32*)(buf->raw + headSize - 4);
+	return nameLen > NAME_MAX*2 || headSize + nameLen <= size;
+}
+
+static romfs_dir* romfs_get_dir(romfs_mount *mount, u32 off, romfs_entry *buf)
+{
+	if (!romFS_lazy(mount))
+		return romFS_dir(mount, off);
+	if (!romfs_load_entry(mount, mount->header.dirTableOff, mount->header.dirTableSize, off, sizeof(romfs_dir), buf))
+		return NULL;
+	return &buf->dir;
+}
+
+static romfs_file* romfs_get_file(romfs_mount *mount, u32 off, romfs_entry *buf)
+{
+	if (!romFS_lazy(mount))
+		return romFS_file(mount, off);
+	if (!romfs_load_entry(mount, mount->header.fileTableOff, mount->header.fileTableSize, off, sizeof(romfs_file), buf))
+		return NULL;
+	return &buf->file;
+}
+
+//-----------------------------------------------------------------------------
+
 static u32 calcHash(u32 parent, u16* name, u32 namelen, u32 total)
 {
 	u32 hash = parent ^ 123456789;
@@ -367,53 +818,275 @@ static u32 calcHash(u32 parent, u16* name, u32 namelen, u32 total)
 	return hash % total;
 }
 
-static romfs_dir* searchForDir(romfs_mount *mount, romfs_dir* parent, u16* name, u32 namelen)
+static int searchForDir(romfs_mount *mount, u32 parent, u16* name, u32 namelen, u32 *pOff)
 {
-	u32 parentOff = (u32)parent - (u32)mount->dirTable;
-	u32 hash = calcHash(parentOff, name, namelen, mount->header.dirHashTableSize/4);
+	u32 hash = calcHash(parent, name, namelen, mount->header.dirHashTableSize/4);
+	romfs_entry buf;
 	romfs_dir* curDir = NULL;
 	u32 curOff;
-	for (curOff = mount->dirHashTable[hash]; curOff != romFS_none; curOff = curDir->nextHash)
+	if (!romfs_get_bucket(mount, mount->dirHashTable, mount->header.dirHashTableOff, hash, &curOff))
+		return EIO;
+	for (; curOff != romFS_none; curOff = curDir->nextHash)
 	{
-		curDir = romFS_dir(mount, curOff);
-		if (curDir->parent != parentOff) continue;
+		curDir = romfs_get_dir(mount, curOff, &buf);
+		if (!curDir) return EIO;
+		if (curDir->parent != parent) continue;
 		if (curDir->nameLen != namelen*2) continue;
+		if (!romFS_name_fits(mount, curDir->nameLen)) continue;
 		if (memcmp(curDir->name, name, namelen*2) != 0) continue;
-		return curDir;
+		*pOff = curOff;
+		return 0;
 	}
-	return NULL;
+	return ENOENT;
 }
 
-static romfs_file* searchForFile(romfs_mount *mount, romfs_dir* parent, u16* name, u32 namelen)
+static int searchForFile(romfs_mount *mount, u32 parent, u16* name, u32 namelen, u32 *pOff)
 {
-	u32 parentOff = (u32)parent - (u32)mount->dirTable;
-	u32 hash = calcHash(parentOff, name, namelen, mount->header.fileHashTableSize/4);
+	u32 hash = calcHash(parent, name, namelen, mount->header.fileHashTableSize/4);
+	romfs_entry buf;
 	romfs_file* curFile = NULL;
 	u32 curOff;
-	for (curOff = mount->fileHashTable[hash]; curOff != romFS_none; curOff = curFile->nextHash)
+	if (!romfs_get_bucket(mount, mount->fileHashTable, mount->header.fileHashTableOff, hash, &curOff))
+		return EIO;
+	for (; curOff != romFS_none; curOff = curFile->nextHash)
 	{
-		curFile = romFS_file(mount, curOff);
-		if (curFile->parent != parentOff) continue;
+		curFile = romfs_get_file(mount, curOff, &buf);
+		if (!curFile) return EIO;
+		if (curFile->parent != parent) continue;
 		if (curFile->nameLen != namelen*2) continue;
+		if (!romFS_name_fits(mount, curFile->nameLen)) continue;
 		if (memcmp(curFile->name, name, namelen*2) != 0) continue;
-		return curFile;
+		*pOff = curOff;
+		return 0;
+	}
+	return ENOENT;
+}
+
+static u32 indexHash(const char *path)
+{
+	// FNV-1a
+	u32 hash = 2166136261U;
+	while (*path)
+	{
+		hash ^= (u8)*path++;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+// Appends an entry name to the path being built, returning the new length
+static ssize_t indexAppend(char *path, size_t len, const u16 *name, u32 nameLen)
+{
+	if (nameLen/2 > PATH_MAX)
+		return -1;
+	memcpy(__ctru_dev_utf16_buf, name, nameLen);
+	__ctru_dev_utf16_buf[nameLen/2] = 0;
+
+	if (len)
+		path[len++] = '/';
+	if (len >= PATH_MAX)
+		return -1;
+
+	ssize_t units = utf16_to_utf8((uint8_t*)path + len, __ctru_dev_utf16_buf, PATH_MAX - len);
+	if (units < 0 || len + units >= PATH_MAX)
+		return -1;
+
+	len += units;
+	path[len] = 0;
+	return len;
+}
+
+static size_t indexStrip(char *path, size_t len)
+{
+	while (len && path[len-1] != '/')
+		len--;
+	if (len)
+		len--;
+	path[len] = 0;
+	return len;
+}
+
+static void indexInsert(romfs_index *index, u32 *poolPos, const char *path, size_t len, u32 entry)
+{
+	u32 hash = indexHash(path);
+	u32 i = hash & index->mask;
+	while (index->slots[i].entry != romFS_none)
+		i = (i + 1) & index->mask;
+
+	index->slots[i].hash    = hash;
+	index->slots[i].pathOff = *poolPos;
+	index->slots[i].entry   = entry;
+	memcpy(index->paths + *poolPos, path, len + 1);
+	*poolPos += len + 1;
+}
+
+// Walks the whole tree, either counting entries and path bytes or inserting them
+static bool indexWalk(romfs_mount *mount, romfs_index *index, u32 *count, u32 *poolSize)
+{
+	char *path = __ctru_dev_path_buf;
+	size_t len = 0;
+	ssize_t flen;
+	romfs_entry dirBuf, fileBuf;
+	u32 dirOff = romFS_root;
+	romfs_dir *dir = romfs_get_dir(mount, dirOff, &dirBuf);
+	romfs_file *file;
+	u32 poolPos = 0;
+
+	if (!dir)
+		return false;
+
+	path[0] = 0;
+	for (;;)
+	{
+		// The directory itself
+		(*count)++;
+		*poolSize += len + 1;
+		if (index)
+			indexInsert(index, &poolPos, path, len, dirOff | romFS_index_dir);
+
+		// Its files
+		for (u32 off = dir->childFile; off != romFS_none; off = file->sibling)
+		{
+			if (!(file = romfs_get_file(mount, off, &fileBuf)) || !romFS_name_fits(mount, file->nameLen))
+				return false;
+			if ((flen = indexAppend(path, len, file->name, file->nameLen)) < 0)
+				return false;
+			(*count)++;
+			*poolSize += flen + 1;
+			if (index)
+				indexInsert(index, &poolPos, path, flen, off);
+			path[len] = 0;
+		}
+
+		// Move on to the next directory, depth first
+		if (dir->childDir == romFS_none)
+		{
+			while (dirOff != romFS_root && dir->sibling == romFS_none)
+			{
+				dirOff = dir->parent;
+				if (!(dir = romfs_get_dir(mount, dirOff, &dirBuf)))
+					return false;
+				len = indexStrip(path, len);
+			}
+			if (dirOff == romFS_root)
+				break;
+			len = indexStrip(path, len);
+			dirOff = dir->sibling;
+		}
+		else
+			dirOff = dir->childDir;
+
+		if (!(dir = romfs_get_dir(mount, dirOff, &dirBuf)) || !romFS_name_fits(mount, dir->nameLen))
+			return false;
+		if ((flen = indexAppend(path, len, dir->name, dir->nameLen)) < 0)
+			return false;
+		len = flen;
+	}
+
+	return true;
+}
+
+Result romfsBuildIndex(const char *name, size_t *memUsed)
+{
+	romfs_mount *mount = romfs_find(name);
+	if (mount == NULL)
+		return MAKERESULT(RL_STATUS, RS_NOTFOUND, RM_ROMFS, RD_NOT_FOUND);
+
+	romfs_index_free(&mount->index);
+	if (memUsed)
+		*memUsed = 0;
+
+	u32 count = 0, poolSize = 0;
+	if (!indexWalk(mount, NULL, &count, &poolSize))
+		return MAKERESULT(RL_PERMANENT, RS_INVALIDARG, RM_ROMFS, RD_OUT_OF_RANGE);
+
+	// Keep the load factor under 3/4
+	u32 slots = 1;
+	while (slots < count + count/3 + 1)
+		slots <<= 1;
+
+	romfs_index index;
+	index.mask  = slots - 1;
+	index.slots = (romfs_index_slot*)malloc(slots * sizeof(romfs_index_slot));
+	index.paths = (char*)malloc(poolSize);
+	if (!index.slots || !index.paths)
+	{
+		romfs_index_free(&index);
+		return MAKERESULT(RL_FATAL, RS_OUTOFRESOURCE, RM_ROMFS, RD_OUT_OF_MEMORY);
+	}
+
+	for (u32 i = 0; i < slots; i ++)
+		index.slots[i].entry = romFS_none;
+
+	count = poolSize = 0;
+	if (!indexWalk(mount, &index, &count, &poolSize))
+	{
+		romfs_index_free(&index);
+		return MAKERESULT(RL_FATAL, RS_INVALIDSTATE, RM_ROMFS, RD_NO_DATA);
+	}
+
+	mount->index = index;
+	if (memUsed)
+		*memUsed = slots * sizeof(romfs_index_slot) + poolSize;
+	return 0;
+}
+
+// Returns the table offset of the entry, with romFS_index_dir set for
+// directories, or romFS_none
+static u32 indexFind(romfs_mount *mount, const char *path)
+{
+	romfs_index *index = &mount->index;
+	if (!index->slots)
+		return romFS_none;
+
+	const char *colonPos = strchr(path, ':');
+	if (colonPos) path = colonPos+1;
+	if (!*path)
+		return romFS_none;
+
+	// The index is keyed on paths relative to the root
+	if (*path == '/')
+		path++;
+	else if (mount->cwd != romFS_root)
+		return romFS_none;
+
+	// Anything not found (including paths with . or .. components) is left
+	// to the regular lookup
+	u32 hash = indexHash(path);
+	for (u32 i = hash & index->mask; index->slots[i].entry != romFS_none; i = (i + 1) & index->mask)
+	{
+		romfs_index_slot *slot = &index->slots[i];
+		if (slot->hash == hash && strcmp(index->paths + slot->pathOff, path) == 0)
+			return slot->entry;
 	}
-	return NULL;
+
+	return romFS_none;
 }
 
-static int navigateToDir(romfs_mount *mount, romfs_dir** ppDir, const char** pPath, bool isDir)
+static int navigateToDir(romfs_mount *mount, u32* pDir, const char** pPath, bool isDir)
 {
 	ssize_t units;
+	romfs_entry buf;
+	romfs_dir* dir;
+	int err;
+
+	u32 entry = isDir ? indexFind(mount, *pPath) : romFS_none;
+	if (entry != romFS_none && (entry & romFS_index_dir))
+	{
+		*pDir = entry &~ romFS_index_dir;
+		*pPath += strlen(*pPath);
+		return 0;
+	}
 
 	char* colonPos = strchr(*pPath, ':');
 	if (colonPos) *pPath = colonPos+1;
 	if (!**pPath)
 		return EILSEQ;
 
-	*ppDir = mount->cwd;
+	*pDir = mount->cwd;
 	if (**pPath == '/')
 	{
-		*ppDir = romFS_root(mount);
+		*pDir = romFS_root;
 		(*pPath)++;
 	}
 
@@ -445,7 +1118,9 @@ static int navigateToDir(romfs_mount *mount, romfs_dir** ppDir, const char** pPa
 			if (!component[1]) continue;
 			if (component[1]=='.' && !component[2])
 			{
-				*ppDir = romFS_dir(mount, (*ppDir)->parent);
+				if (!(dir = romfs_get_dir(mount, *pDir, &buf)))
+					return EIO;
+				*pDir = dir->parent;
 				continue;
 			}
 		}
@@ -456,17 +1131,56 @@ static int navigateToDir(romfs_mount *mount, romfs_dir** ppDir, const char** pPa
 		if (units > PATH_MAX)
 			return ENAMETOOLONG;
 
-		*ppDir = searchForDir(mount, *ppDir, __ctru_dev_utf16_buf, units);
-		if (!*ppDir)
-			return ENOENT;
+		err = searchForDir(mount, *pDir, __ctru_dev_utf16_buf, units, pDir);
+		if (err != 0)
+			return err;
 	}
 
 	return 0;
 }
 
-static ino_t dir_inode(romfs_mount *mount, romfs_dir *dir)
+static romfs_file* findFile(romfs_mount *mount, const char *path, romfs_entry *buf, u32 *pOff, int *err)
+{
+	romfs_file* file;
+	u32 entry = indexFind(mount, path);
+	if (entry != romFS_none && !(entry & romFS_index_dir))
+	{
+		file = romfs_get_file(mount, entry, buf);
+		*err = file ? 0 : EIO;
+		*pOff = entry;
+		return file;
+	}
+
+	u32 curDir = romFS_root;
+	*err = navigateToDir(mount, &curDir, &path, false);
+	if (*err != 0)
+		return NULL;
+
+	ssize_t units = utf8_to_utf16(__ctru_dev_utf16_buf, (const uint8_t*)path, PATH_MAX);
+	if (units <= 0)
+	{
+		*err = EILSEQ;
+		return NULL;
+	}
+	if (units >= PATH_MAX)
+	{
+		*err = ENAMETOOLONG;
+		return NULL;
+	}
+
+	*err = searchForFile(mount, curDir, __ctru_dev_utf16_buf, units, pOff);
+	if (*err != 0)
+		return NULL;
+
+	file = romfs_get_file(mount, *pOff, buf);
+	if (!file)
+		*err = EIO;
+	return file;
+}
+
+static ino_t dir_inode(romfs_mount *mount, u32 off)
 {
-	return (uint32_t*)dir - (uint32_t*)mount->dirTable;
+	return off/4;
 }
 
 static off_t dir_size(romfs_dir *dir)
@@ -476,20 +1190,24 @@ static off_t dir_size(romfs_dir *dir)
 
 static nlink_t dir_nlink(romfs_mount *mount, romfs_dir *dir)
 {
-	nlink_t count = 2; // one for self, one for parent
-	u32     offset = dir->childDir;
+	nlink_t     count = 2; // one for self, one for parent
+	u32         offset = dir->childDir;
+	u32         childFile = dir->childFile;
+	romfs_entry buf;
 
 	while(offset != romFS_none)
 	{
-		romfs_dir *tmp = romFS_dir(mount, offset);
+		romfs_dir *tmp = romfs_get_dir(mount, offset, &buf);
+		if (!tmp) break;
 		++count;
 		offset = tmp->sibling;
 	}
 
-	offset = dir->childFile;
+	offset = childFile;
 	while(offset != romFS_none)
 	{
-		romfs_file *tmp = romFS_file(mount, offset);
+		romfs_file *tmp = romfs_get_file(mount, offset, &buf);
+		if (!tmp) break;
 		++count;
 		offset = tmp->sibling;
 	}
@@ -497,15 +1215,15 @@ static nlink_t dir_nlink(romfs_mount *mount, romfs_dir *dir)
 	return count;
 }
 
-static ino_t file_inode(romfs_mount *mount, romfs_file *file)
+static ino_t file_inode(romfs_mount *mount, u32 off)
 {
-	return ((uint32_t*)file - (uint32_t*)mount->fileTable) + mount->header.dirTableSize/4;
+	return off/4 + mount->header.dirTableSize/4;
 }
 
-static void fill_dir(struct stat *st, romfs_mount *mount, romfs_dir *dir)
+static void fill_dir(struct stat *st, romfs_mount *mount, u32 off, romfs_dir *dir)
 {
 	memset(st, 0, sizeof(*st));
-	st->st_ino     = dir_inode(mount, dir);
+	st->st_ino     = dir_inode(mount, off);
 	st->st_mode    = romFS_dir_mode;
 	st->st_nlink   = dir_nlink(mount, dir);
 	st->st_size    = dir_size(dir);
@@ -514,18 +1232,38 @@ static void fill_dir(struct stat *st, romfs_mount *mount, romfs_dir *dir)
 	st->st_atime   = st->st_mtime = st->st_ctime = mount->mtime;
 }
 
-static void fill_file(struct stat *st, romfs_mount *mount, romfs_file *file)
+static void fill_file(struct stat *st, romfs_mount *mount, u32 off, u64 size)
 {
 	memset(st, 0, sizeof(*st));
-	st->st_ino     = file_inode(mount, file);
+	st->st_ino     = file_inode(mount, off);
 	st->st_mode    = romFS_file_mode;
 	st->st_nlink   = 1;
-	st->st_size    = (off_t)file->dataSize;
+	st->st_size    = (off_t)size;
 	st->st_blksize = 512;
 	st->st_blocks  = (st->st_blksize + 511) / 512;
 	st->st_atime   = st->st_mtime = st->st_ctime = mount->mtime;
 }
 
+static int stat_dir(struct stat *st, romfs_mount *mount, u32 off)
+{
+	romfs_entry buf;
+	romfs_dir *dir = romfs_get_dir(mount, off, &buf);
+	if (!dir)
+		return EIO;
+	fill_dir(st, mount, off, dir);
+	return 0;
+}
+
+static int stat_file(struct stat *st, romfs_mount *mount, u32 off)
+{
+	romfs_entry buf;
+	romfs_file *file = romfs_get_file(mount, off, &buf);
+	if (!file)
+		return EIO;
+	fill_file(st, mount, off, file->dataSize);
+	return 0;
+}
+
 //-----------------------------------------------------------------------------
 
 int romfs_open(struct _reent *r, void *fileStruct, const char *path, int flags, int mode)
@@ -540,30 +1278,13 @@ int romfs_open(struct _reent *r, void *fileStruct, const char *path, int flags,
 		return -1;
 	}
 
-	romfs_dir* curDir = NULL;
-	r->_errno = navigateToDir(fileobj->mount, &curDir, &path, false);
-	if (r->_errno != 0)
-		return -1;
-
-	ssize_t units = utf8_to_utf16(__ctru_dev_utf16_buf, (const uint8_t*)path, PATH_MAX);
-	if (units <= 0)
-	{
-		r->_errno = EILSEQ;
-		return -1;
-	}
-	if (units >= PATH_MAX)
-	{
-		r->_errno = ENAMETOOLONG;
-		return -1;
-	}
-
-	romfs_file* file = searchForFile(fileobj->mount, curDir, __ctru_dev_utf16_buf, units);
+	romfs_entry buf;
+	u32 entry;
+	romfs_file* file = findFile(fileobj->mount, path, &buf, &entry, &r->_errno);
 	if (!file)
 	{
-		if(flags & O_CREAT)
+		if(r->_errno == ENOENT && (flags & O_CREAT))
 			r->_errno = EROFS;
-		else
-			r->_errno = ENOENT;
 		return -1;
 	}
 	else if((flags & O_CREAT) && (flags & O_EXCL))
@@ -572,9 +1293,12 @@ int romfs_open(struct _reent *r, void *fileStruct, const char *path, int flags,
 		return -1;
 	}
 
-	fileobj->file   = file;
-	fileobj->offset = (u64)fileobj->mount->header.fileDataOff + file->dataOff;
-	fileobj->pos    = 0;
+	fileobj->entry     = entry;
+	fileobj->offset    = (u64)fileobj->mount->header.fileDataOff + file->dataOff;
+	fileobj->size      = file->dataSize;
+	fileobj->pos       = 0;
+	fileobj->cached    = fileobj->mount->cache.cacheByDefault;
+	fileobj->nextBlock = ~(u64)0;
 
 	return 0;
 }
@@ -590,15 +1314,19 @@ ssize_t romfs_read(struct _reent *r, void *fd, char *ptr, size_t len)
 	u64 endPos = file->pos + len;
 
 	/* check if past end-of-file */
-	if(file->pos >= file->file->dataSize)
+	if(file->pos >= file->size)
 		return 0;
 
 	/* truncate the read to end-of-file */
-	if(endPos > file->file->dataSize)
-		endPos = file->file->dataSize;
+	if(endPos > file->size)
+		endPos = file->size;
 	len = endPos - file->pos;
 
-	ssize_t adv = _romfs_read(file->mount, file->offset + file->pos, ptr, len);
+	ssize_t adv;
+	if(file->cached)
+		adv = romfs_cache_read(file->mount, &file->nextBlock, file->offset + file->pos, ptr, len);
+	else
+		adv = _romfs_read(file->mount, file->offset + file->pos, ptr, len);
 	if(adv >= 0)
 	{
 		file->pos += adv;
@@ -624,7 +1352,7 @@ off_t romfs_seek(struct _reent *r, void *fd, off_t pos, int dir)
 			break;
 
 		case SEEK_END:
-			start = file->file->dataSize;
+			start = file->size;
 			break;
 
 		default:
@@ -655,22 +1383,32 @@ off_t romfs_seek(struct _reent *r, void *fd, off_t pos, int dir)
 int romfs_fstat(struct _reent *r, void *fd, struct stat *st)
 {
 	romfs_fileobj* fileobj = (romfs_fileobj*)fd;
-	fill_file(st, fileobj->mount, fileobj->file);
+	fill_file(st, fileobj->mount, fileobj->entry, fileobj->size);
 	return 0;
 }
 
 int romfs_stat(struct _reent *r, const char *path, struct stat *st)
 {
 	romfs_mount* mount = (romfs_mount*)r->deviceData;
-	romfs_dir* curDir = NULL;
+	u32 entry = indexFind(mount, path);
+	if (entry != romFS_none)
+	{
+		if (entry & romFS_index_dir)
+			r->_errno = stat_dir(st, mount, entry &~ romFS_index_dir);
+		else
+			r->_errno = stat_file(st, mount, entry);
+		return r->_errno != 0 ? -1 : 0;
+	}
+
+	u32 curDir = romFS_root;
 	r->_errno = navigateToDir(mount, &curDir, &path, false);
 	if(r->_errno != 0)
 		return -1;
 
 	if (!*path)
 	{
-		fill_dir(st, mount, curDir);
-		return 0;
+		r->_errno = stat_dir(st, mount, curDir);
+		return r->_errno != 0 ? -1 : 0;
 	}
 
 	ssize_t units = utf8_to_utf16(__ctru_dev_utf16_buf, (const uint8_t*)path, PATH_MAX);
@@ -685,28 +1423,24 @@ int romfs_stat(struct _reent *r, const char *path, struct stat *st)
 		return -1;
 	}
 
-	romfs_dir* dir = searchForDir(mount, curDir, __ctru_dev_utf16_buf, units);
-	if(dir)
-	{
-		fill_dir(st, mount, dir);
-		return 0;
-	}
-
-	romfs_file* file = searchForFile(mount, curDir, __ctru_dev_utf16_buf, units);
-	if(file)
+	u32 off;
+	r->_errno = searchForDir(mount, curDir, __ctru_dev_utf16_buf, units, &off);
+	if(r->_errno == 0)
+		r->_errno = stat_dir(st, mount, off);
+	else if(r->_errno == ENOENT)
 	{
-		fill_file(st, mount, file);
-		return 0;
+		r->_errno = searchForFile(mount, curDir, __ctru_dev_utf16_buf, units, &off);
+		if(r->_errno == 0)
+			r->_errno = stat_file(st, mount, off);
 	}
 
-	r->_errno = ENOENT;
-	return -1;
+	return r->_errno != 0 ? -1 : 0;
 }
 
 int romfs_chdir(struct _reent *r, const char *path)
 {
 	romfs_mount* mount = (romfs_mount*)r->deviceData;
-	romfs_dir* curDir = NULL;
+	u32 curDir = romFS_root;
 	r->_errno = navigateToDir(mount, &curDir, &path, true);
 	if (r->_errno != 0)
 		return -1;
@@ -718,17 +1452,28 @@ int romfs_chdir(struct _reent *r, const char *path)
 DIR_ITER* romfs_diropen(struct _reent *r, DIR_ITER *dirState, const char *path)
 {
 	romfs_diriter* iter = (romfs_diriter*)(dirState->dirStruct);
-	romfs_dir* curDir = NULL;
+	romfs_entry buf;
+	romfs_dir* dir;
+	u32 curDir = romFS_root;
 	iter->mount = (romfs_mount*)r->deviceData;
 
 	r->_errno = navigateToDir(iter->mount, &curDir, &path, true);
 	if(r->_errno != 0)
 		return NULL;
 
+	if(!(dir = romfs_get_dir(iter->mount, curDir, &buf)))
+	{
+		r->_errno = EIO;
+		return NULL;
+	}
+
 	iter->dir       = curDir;
+	iter->parent    = dir->parent;
+	iter->firstDir  = dir->childDir;
+	iter->firstFile = dir->childFile;
 	iter->state     = 0;
-	iter->childDir  = curDir->childDir;
-	iter->childFile = curDir->childFile;
+	iter->childDir  = iter->firstDir;
+	iter->childFile = iter->firstFile;
 
 	return dirState;
 }
@@ -738,16 +1483,68 @@ int romfs_dirreset(struct _reent *r, DIR_ITER *dirState)
 	romfs_diriter* iter = (romfs_diriter*)(dirState->dirStruct);
 
 	iter->state     = 0;
-	iter->childDir  = iter->dir->childDir;
-	iter->childFile = iter->dir->childFile;
+	iter->childDir  = iter->firstDir;
+	iter->childFile = iter->firstFile;
+
+	return 0;
+}
+
+static int romfs_dirnext_name(struct _reent *r, romfs_mount *mount, const u16 *name, u32 nameLen, char *filename)
+{
+	ssize_t units;
+	bool    truncated = false;
+
+	if(nameLen > NAME_MAX*sizeof(uint16_t))
+	{
+		/* lazy mounts only read in the start of long names */
+		if(romFS_lazy(mount))
+		{
+			r->_errno = ENAMETOOLONG;
+			return -1;
+		}
+
+		/* don't split a surrogate pair */
+		nameLen   = NAME_MAX*sizeof(uint16_t);
+		truncated = true;
+		if((name[nameLen/sizeof(uint16_t)-1] & 0xFC00) == 0xD800)
+			nameLen -= sizeof(uint16_t);
+	}
+
+	/* convert name from UTF-16 to UTF-8 */
+	memset(filename, 0, NAME_MAX);
+	memcpy(__ctru_dev_utf16_buf, name, nameLen);
+	__ctru_dev_utf16_buf[nameLen/sizeof(uint16_t)] = 0;
+	units = utf16_to_utf8((uint8_t*)filename, __ctru_dev_utf16_buf, NAME_MAX-1);
+
+	if(units < 0)
+	{
+		r->_errno = EILSEQ;
+		return -1;
+	}
+
+	if(units >= NAME_MAX)
+	{
+		if(romFS_lazy(mount))
+		{
+			r->_errno = ENAMETOOLONG;
+			return -1;
+		}
+
+		/* list the entry under as much of its name as fits, in whole characters */
+		truncated = true;
+	}
+
+	if(truncated)
+		units = strlen(filename);
+	filename[units] = 0;
 
 	return 0;
 }
 
 int romfs_dirnext(struct _reent *r, DIR_ITER *dirState, char *filename, struct stat *filestat)
 {
-	ssize_t        units;
 	romfs_diriter* iter = (romfs_diriter*)(dirState->dirStruct);
+	romfs_entry    buf;
 
 	if(iter->state == 0)
 	{
@@ -763,10 +1560,8 @@ int romfs_dirnext(struct _reent *r, DIR_ITER *dirState, char *filename, struct s
 	else if(iter->state == 1)
 	{
 		/* '..' entry */
-		romfs_dir* dir = romFS_dir(iter->mount, iter->dir->parent);
-
 		memset(filestat, 0, sizeof(*filestat));
-		filestat->st_ino = dir_inode(iter->mount, dir);
+		filestat->st_ino = dir_inode(iter->mount, iter->parent);
 		filestat->st_mode = romFS_dir_mode;
 
 		strcpy(filename, "..");
@@ -776,65 +1571,35 @@ int romfs_dirnext(struct _reent *r, DIR_ITER *dirState, char *filename, struct s
 
 	if(iter->childDir != romFS_none)
 	{
-		romfs_dir* dir = romFS_dir(iter->mount, iter->childDir);
-		iter->childDir = dir->sibling;
-
-		memset(filestat, 0, sizeof(*filestat));
-		filestat->st_ino = dir_inode(iter->mount, dir);
-		filestat->st_mode = romFS_dir_mode;
-
-		/* convert name from UTF-16 to UTF-8 */
-		memset(filename, 0, NAME_MAX);
-		memcpy(__ctru_dev_utf16_buf, dir->name, dir->nameLen*sizeof(uint16_t));
-		__ctru_dev_utf16_buf[dir->nameLen/sizeof(uint16_t)] = 0;
-		units = utf16_to_utf8((uint8_t*)filename, __ctru_dev_utf16_buf, NAME_MAX);
-
-		if(units < 0)
-		{
-			r->_errno = EILSEQ;
-			return -1;
-		}
-
-		if(units >= NAME_MAX)
+		romfs_dir* dir = romfs_get_dir(iter->mount, iter->childDir, &buf);
+		if(!dir)
 		{
-			r->_errno = ENAMETOOLONG;
+			r->_errno = EIO;
 			return -1;
 		}
 
-		filename[units] = 0;
+		memset(filestat, 0, sizeof(*filestat));
+		filestat->st_ino = dir_inode(iter->mount, iter->childDir);
+		filestat->st_mode = romFS_dir_mode;
+		iter->childDir = dir->sibling;
 
-		return 0;
+		return romfs_dirnext_name(r, iter->mount, dir->name, dir->nameLen, filename);
 	}
 	else if(iter->childFile != romFS_none)
 	{
-		romfs_file* file = romFS_file(iter->mount, iter->childFile);
-		iter->childFile = file->sibling;
-
-		memset(filestat, 0, sizeof(*filestat));
-		filestat->st_ino = file_inode(iter->mount, file);
-		filestat->st_mode = romFS_file_mode;
-
-		/* convert name from UTF-16 to UTF-8 */
-		memset(filename, 0, NAME_MAX);
-		memcpy(__ctru_dev_utf16_buf, file->name, file->nameLen*sizeof(uint16_t));
-		__ctru_dev_utf16_buf[file->nameLen/sizeof(uint16_t)] = 0;
-		units = utf16_to_utf8((uint8_t*)filename, __ctru_dev_utf16_buf, NAME_MAX);
-
-		if(units < 0)
-		{
-			r->_errno = EILSEQ;
-			return -1;
-		}
-
-		if(units >= NAME_MAX)
+		romfs_file* file = romfs_get_file(iter->mount, iter->childFile, &buf);
+		if(!file)
 		{
-			r->_errno = ENAMETOOLONG;
+			r->_errno = EIO;
 			return -1;
 		}
 
-		filename[units] = 0;
+		memset(filestat, 0, sizeof(*filestat));
+		filestat->st_ino = file_inode(iter->mount, iter->childFile);
+		filestat->st_mode = romFS_file_mode;
+		iter->childFile = file->sibling;
 
-		return 0;
+		return romfs_dirnext_name(r, iter->mount, file->name, file->nameLen, filename);
 	}
 
 	r->_errno = ENOENT;
@@ -845,3 +1610,83 @@ int romfs_dirclose(struct _reent *r, DIR_ITER *dirState)
 {
 	return 0;
 }
+
+//-----------------------------------------------------------------------------
+
+Result romfsMapFile(const char *path, void* (*alloc)(size_t size), void (*dealloc)(void *mem), const void **data, size_t *size)
+{
+	*data = NULL;
+	*size = 0;
+
+	// Pick the device named by the path, defaulting to "romfs"
+	char name[sizeof(((romfs_mount*)0)->name)] = "romfs";
+	const char *colonPos = strchr(path, ':');
+	if (colonPos)
+	{
+		size_t len = colonPos - path;
+		if (len >= sizeof(name))
+			return MAKERESULT(RL_USAGE, RS_INVALIDARG, RM_ROMFS, RD_OUT_OF_RANGE);
+		memcpy(name, path, len);
+		name[len] = 0;
+	}
+
+	romfs_mount *mount = romfs_find(name);
+	if (mount == NULL)
+		return MAKERESULT(RL_STATUS, RS_NOTFOUND, RM_ROMFS, RD_NOT_FOUND);
+
+	int err;
+	u32 entry;
+	romfs_entry fileBuf;
+	romfs_file *file = findFile(mount, path, &fileBuf, &entry, &err);
+	if (!file)
+		return MAKERESULT(RL_PERMANENT, RS_NOTFOUND, RM_ROMFS, RD_NOT_FOUND);
+	if (file->dataSize > UINT32_MAX)
+		return MAKERESULT(RL_USAGE, RS_NOTSUPPORTED, RM_ROMFS, RD_OUT_OF_RANGE);
+
+	u32 fileSize = file->dataSize;
+	u64 offset = (u64)mount->header.fileDataOff + file->dataOff;
+
+	// Files of in-memory images are already where they need to be
+	if (mount->image)
+	{
+		if (offset > mount->imageSize || fileSize > mount->imageSize - offset)
+			return MAKERESULT(RL_FATAL, RS_INVALIDSTATE, RM_ROMFS, RD_NO_DATA);
+		*data = mount->image + offset;
+		*size = fileSize;
+		return 0;
+	}
+
+	// Read the file in one go, straight into its final location
+	if (!alloc)
+	{
+		alloc   = malloc;
+		dealloc = free;
+	}
+
+	void *buf = alloc(fileSize);
+	if (!buf)
+		return fileSize ? MAKERESULT(RL_FATAL, RS_OUTOFRESOURCE, RM_ROMFS, RD_OUT_OF_MEMORY) : 0;
+
+	if (!_romfs_read_chk(mount, offset, buf, fileSize))
+	{
+		if (dealloc)
+			dealloc(buf);
+		return MAKERESULT(RL_FATAL, RS_INVALIDSTATE, RM_ROMFS, RD_NO_DATA);
+	}
+
+	*data = buf;
+	*size = fileSize;
+	return 0;
+}
+
+void romfsUnmapFile(const void *data, void (*dealloc)(void *mem))
+{
+	if (!data)
+		return;
+
+	for (romfs_mount *mount = romfs_mount_list; mount; mount = mount->next)
+		if (romfs_in_image(mount, data))
+			return;
+
+	(dealloc ? dealloc : free)((void*)data);
+}
@@ -126,6 +126,8 @@ void threadExit(int rc)
 	if (!t)
 		__panic();
 
+	__linear_thread_exit();
+
 	t->finished = true;
 	if (t->detached)
 		threadFree(t);
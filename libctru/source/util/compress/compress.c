@@ -0,0 +1,651 @@
+/** @file compress.c
+ *  @brief Compression routines
+ */
+#include <3ds/util/compress.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LZ_WINDOW     4096 ///< LZ sliding window size
+#define LZ_MINMATCH   3    ///< Shortest encodable match
+#define LZ_HASHBITS   12   ///< Match finder hash size in bits
+#define LZ_FASTDEPTH  16   ///< Hash chain depth for COMPRESS_FAST
+
+#define LZSS_MAXMATCH 0x12    ///< Longest LZSS/LZ10 match
+#define LZ11_MAXMATCH 0x10110 ///< Longest LZ11 match
+
+/** @brief Output buffer */
+typedef struct
+{
+  uint8_t *data; ///< Pointer to buffer
+  size_t  limit; ///< Max buffer size
+  size_t  pos;   ///< Buffer position
+} writer_t;
+
+/** @brief LZ match finder */
+typedef struct
+{
+  const uint8_t *data;                  ///< Input data
+  size_t        size;                   ///< Input size
+  size_t        depth;                  ///< Max hash chain depth
+  int32_t       head[1 << LZ_HASHBITS]; ///< Most recent position per hash
+  int32_t       prev[LZ_WINDOW];        ///< Previous position per window slot
+} lz_finder;
+
+/** @brief Huffman tree node */
+typedef struct
+{
+  uint32_t freq;  ///< Symbol frequency
+  int16_t  child; ///< Left child, or -1 for data nodes
+  int16_t  right; ///< Right child
+  uint8_t  sym;   ///< Symbol for leaf nodes
+  uint16_t addr;  ///< Address in the encoded tree
+} huff_node;
+
+/** @brief Write a byte
+ *  @param[in] out  Output buffer
+ *  @param[in] byte Byte to write
+ *  @returns Whether succeeded
+ */
+static inline bool
+writer_put(writer_t *out, uint8_t byte)
+{
+  if(out->pos >= out->limit)
+    return false;
+
+  out->data[out->pos++] = byte;
+  return true;
+}
+
+/** @brief Write compression header
+ *  @param[in] out  Output buffer
+ *  @param[in] type Compression type
+ *  @param[in] size Uncompressed size
+ *  @returns Whether succeeded
+ */
+static bool
+writer_header(writer_t *out, decompressType type, size_t size)
+{
+  if(size > 0xFFFFFFFF)
+    return false;
+
+  // sizes which don't fit in 24 bits use the extended header
+  bool extended = size > 0xFFFFFF;
+
+  if(!writer_put(out, type | (extended ? 0x80 : 0x00))
+  || !writer_put(out, size >>  0)
+  || !writer_put(out, size >>  8)
+  || !writer_put(out, size >> 16))
+    return false;
+
+  if(extended)
+  {
+    if(!writer_put(out, size >> 24)
+    || !writer_put(out, 0)
+    || !writer_put(out, 0)
+    || !writer_put(out, 0))
+      return false;
+  }
+
+  return true;
+}
+
+/** @brief Hash the next three bytes
+ *  @param[in] data Data to hash
+ *  @returns Hash
+ */
+static inline uint32_t
+lz_hash(const uint8_t *data)
+{
+  uint32_t value = data[0] << 16 | data[1] << 8 | data[2];
+  return (value * 2654435761u) >> (32 - LZ_HASHBITS);
+}
+
+/** @brief Insert a position into the match finder
+ *  @param[in] lz  LZ match finder
+ *  @param[in] pos Position to insert
+ */
+static inline void
+lz_insert(lz_finder *lz, size_t pos)
+{
+  if(pos + LZ_MINMATCH > lz->size)
+    return;
+
+  uint32_t hash = lz_hash(&lz->data[pos]);
+  lz->prev[pos & (LZ_WINDOW-1)] = lz->head[hash];
+  lz->head[hash] = pos;
+}
+
+/** @brief Find the longest match for a position
+ *  @param[in]  lz       LZ match finder
+ *  @param[in]  pos      Position to match
+ *  @param[in]  maxmatch Longest encodable match
+ *  @param[out] disp     Match displacement
+ *  @returns Match length
+ *  @retval 0 no match
+ */
+static size_t
+lz_match(const lz_finder *lz, size_t pos, size_t maxmatch, size_t *disp)
+{
+  if(maxmatch > lz->size - pos)
+    maxmatch = lz->size - pos;
+
+  if(maxmatch < LZ_MINMATCH)
+    return 0;
+
+  const uint8_t *data = lz->data;
+  size_t        best  = 0;
+  size_t        depth = lz->depth;
+  int32_t       cand  = lz->head[lz_hash(&data[pos])];
+
+  while(cand >= 0 && depth-- > 0 && pos - cand <= LZ_WINDOW)
+  {
+    // reject candidates which can't beat the current best
+    if(data[cand + best] == data[pos + best])
+    {
+      size_t len = 0;
+      while(len < maxmatch && data[cand + len] == data[pos + len])
+        ++len;
+
+      if(len > best)
+      {
+        best  = len;
+        *disp = pos - cand;
+        if(len == maxmatch)
+          break;
+      }
+    }
+
+    // window slots are reused, so stop once the chain stops going backwards
+    int32_t next = lz->prev[cand & (LZ_WINDOW-1)];
+    if(next >= cand)
+      break;
+
+    cand = next;
+  }
+
+  return best >= LZ_MINMATCH ? best : 0;
+}
+
+/** @brief Write an LZ back-reference
+ *  @param[in] out  Output buffer
+ *  @param[in] type Compression type
+ *  @param[in] len  Match length
+ *  @param[in] disp Match displacement
+ *  @returns Whether succeeded
+ */
+static bool
+lz_token(writer_t *out, decompressType type, size_t len, size_t disp)
+{
+  --disp;
+
+  if(type == DECOMPRESS_LZSS)
+  {
+    return writer_put(out, (len - 3) << 4 | disp >> 8)
+        && writer_put(out, disp);
+  }
+
+  if(len <= 0x10) // normal block
+  {
+    return writer_put(out, (len - 1) << 4 | disp >> 8)
+        && writer_put(out, disp);
+  }
+
+  if(len <= 0x110) // extended block
+  {
+    len -= 0x11;
+    return writer_put(out, len >> 4)
+        && writer_put(out, (len & 0x0F) << 4 | disp >> 8)
+        && writer_put(out, disp);
+  }
+
+  // extra extended block
+  len -= 0x111;
+  return writer_put(out, 0x10 | len >> 12)
+      && writer_put(out, len >> 4)
+      && writer_put(out, (len & 0x0F) << 4 | disp >> 8)
+      && writer_put(out, disp);
+}
+
+/** @brief Compress LZSS/LZ10 or LZ11
+ *  @param[in] type     Compression type
+ *  @param[in] maxmatch Longest encodable match
+ *  @param[in] output   Output buffer
+ *  @param[in] outsize  Output size limit
+ *  @param[in] input    Data to compress
+ *  @param[in] insize   Size of data to compress
+ *  @param[in] level    Compression level
+ *  @returns Compressed size
+ *  @retval -1 error
+ */
+static ssize_t
+compress_lz(decompressType type, size_t maxmatch, void *output, size_t outsize,
+            const void *input, size_t insize, compressLevel level)
+{
+  writer_t out = { output, outsize, 0 };
+  if(!writer_header(&out, type, insize))
+    return -1;
+
+  lz_finder *lz = (lz_finder*)malloc(sizeof(lz_finder));
+  if(!lz)
+    return -1;
+
+  lz->data  = (const uint8_t*)input;
+  lz->size  = insize;
+  lz->depth = level == COMPRESS_BEST ? LZ_WINDOW : LZ_FASTDEPTH;
+  memset(lz->head, 0xFF, sizeof(lz->head));
+
+  size_t  pos     = 0;
+  size_t  flagpos = 0;
+  uint8_t mask    = 0;
+  size_t  len     = 0;
+  size_t  disp    = 0;
+  bool    lazy    = false;
+
+  while(pos < insize)
+  {
+    if(mask == 0)
+    {
+      // reserve the flags byte for the next eight blocks
+      flagpos = out.pos;
+      if(!writer_put(&out, 0))
+      {
+        free(lz);
+        return -1;
+      }
+      mask = 0x80;
+    }
+
+    // a deferred match from the previous position was already searched
+    if(!lazy)
+      len = lz_match(lz, pos, maxmatch, &disp);
+    lazy = false;
+    lz_insert(lz, pos);
+
+    if(len > 0 && level == COMPRESS_BEST && len < maxmatch)
+    {
+      // emit a literal instead if the next position has a longer match
+      size_t nextdisp;
+      size_t nextlen = lz_match(lz, pos + 1, maxmatch, &nextdisp);
+      if(nextlen > len)
+      {
+        len  = nextlen;
+        disp = nextdisp;
+        lazy = true;
+      }
+    }
+
+    if(len > 0 && !lazy) // compressed block
+    {
+      out.data[flagpos] |= mask;
+      if(!lz_token(&out, type, len, disp))
+      {
+        free(lz);
+        return -1;
+      }
+
+      for(size_t i = 1; i < len; ++i)
+        lz_insert(lz, pos + i);
+      pos += len;
+    }
+    else // uncompressed block
+    {
+      if(!writer_put(&out, lz->data[pos++]))
+      {
+        free(lz);
+        return -1;
+      }
+    }
+
+    mask >>= 1;
+  }
+
+  free(lz);
+  return out.pos;
+}
+
+/** @brief Lay out a Huffman tree in the encoded format
+ *  @param[in]  nodes Huffman tree nodes
+ *  @param[in]  root  Root node
+ *  @param[out] tree  Encoded tree
+ *  @returns Whether succeeded
+ *
+ *  Each node's children must be placed within 64 pairs after the node
+ *  itself. Nodes are placed depth-first to keep the number of pending nodes
+ *  small, switching to the oldest pending node when it nears its limit.
+ */
+static bool
+huff_layout(huff_node *nodes, size_t root, uint8_t *tree)
+{
+  int16_t pending[256];
+  size_t  count = 0;
+  size_t  pair;
+
+  nodes[root].addr = 1;
+  pending[count++] = root;
+
+  for(pair = 1; count > 0; ++pair)
+  {
+    if(pair >= 256)
+      return false;
+
+    // pending nodes are ordered oldest first
+    size_t pick     = count - 1;
+    size_t deadline = nodes[pending[0]].addr / 2 + 64;
+    if(deadline - pair <= count)
+      pick = 0;
+
+    huff_node *node = &nodes[pending[pick]];
+    memmove(&pending[pick], &pending[pick+1], (count - pick - 1) * sizeof(pending[0]));
+    --count;
+
+    size_t offset = pair - node->addr / 2 - 1;
+    if(offset > 0x3F)
+      return false;
+
+    tree[node->addr] = offset;
+
+    huff_node *child[2] = { &nodes[node->child], &nodes[node->right] };
+    for(size_t i = 0; i < 2; ++i)
+    {
+      child[i]->addr = pair * 2 + i;
+
+      if(child[i]->child < 0) // data node
+      {
+        tree[node->addr] |= 0x80 >> i;
+        tree[child[i]->addr] = child[i]->sym;
+      }
+      else
+        pending[count++] = child[i] - nodes;
+    }
+  }
+
+  // tree size in pairs, excluding the first
+  tree[0] = pair - 1;
+  return true;
+}
+
+/** @brief Assign Huffman codes
+ *  @param[in]  nodes Huffman tree nodes
+ *  @param[in]  node  Node to assign from
+ *  @param[in]  code  Code for node
+ *  @param[in]  len   Code length for node
+ *  @param[out] codes Code per symbol
+ *  @param[out] lens  Code length per symbol
+ */
+static void
+huff_codes(const huff_node *nodes, size_t node, uint64_t code, size_t len,
+           uint64_t *codes, uint8_t *lens)
+{
+  if(nodes[node].child < 0)
+  {
+    codes[nodes[node].sym] = code;
+    lens[nodes[node].sym]  = len;
+    return;
+  }
+
+  huff_codes(nodes, nodes[node].child, code << 1, len + 1, codes, lens);
+  huff_codes(nodes, nodes[node].right, code << 1 | 1, len + 1, codes, lens);
+}
+
+/** @brief Write a word of Huffman data
+ *  @param[in] out  Output buffer
+ *  @param[in] word Word to write
+ *  @returns Whether succeeded
+ */
+static inline bool
+huff_flush(writer_t *out, uint32_t word)
+{
+  return writer_put(out, word >>  0)
+      && writer_put(out, word >>  8)
+      && writer_put(out, word >> 16)
+      && writer_put(out, word >> 24);
+}
+
+/** @brief Compare Huffman nodes by frequency
+ *  @param[in] lhs First node
+ *  @param[in] rhs Second node
+ *  @returns Comparison result
+ */
+static int
+huff_compare(const void *lhs, const void *rhs)
+{
+  const huff_node *a = (const huff_node*)lhs;
+  const huff_node *b = (const huff_node*)rhs;
+
+  if(a->freq != b->freq)
+    return a->freq < b->freq ? -1 : 1;
+  return (int)a->sym - (int)b->sym;
+}
+
+ssize_t
+compressLZSS(void *output, size_t outsize, const void *input, size_t insize,
+             compressLevel level)
+{
+  return compress_lz(DECOMPRESS_LZSS, LZSS_MAXMATCH, output, outsize, input,
+                     insize, level);
+}
+
+ssize_t
+compressLZ11(void *output, size_t outsize, const void *input, size_t insize,
+             compressLevel level)
+{
+  return compress_lz(DECOMPRESS_LZ11, LZ11_MAXMATCH, output, outsize, input,
+                     insize, level);
+}
+
+ssize_t
+compressHuff(size_t bits, void *output, size_t outsize, const void *input,
+             size_t insize)
+{
+  if(bits < 1 || bits > 8)
+    return -1;
+
+  const uint8_t *data = (const uint8_t*)input;
+  uint32_t      freq[256] = { 0 };
+
+  for(size_t i = 0; i < insize; ++i)
+  {
+    if(data[i] >> bits)
+      return -1;
+    ++freq[data[i]];
+  }
+
+  huff_node *nodes = (huff_node*)malloc(512 * sizeof(huff_node));
+  if(!nodes)
+    return -1;
+
+  size_t leaves = 0;
+  for(size_t i = 0; i < 256; ++i)
+  {
+    if(freq[i] == 0)
+      continue;
+
+    nodes[leaves].freq  = freq[i];
+    nodes[leaves].child = -1;
+    nodes[leaves].sym   = i;
+    ++leaves;
+  }
+
+  // the tree needs at least two data nodes
+  while(leaves < 2)
+  {
+    nodes[leaves].freq  = 0;
+    nodes[leaves].child = -1;
+    nodes[leaves].sym   = leaves == 0 ? 0 : !nodes[0].sym;
+    ++leaves;
+  }
+
+  qsort(nodes, leaves, sizeof(huff_node), huff_compare);
+
+  // merge the two lightest nodes from the sorted leaves and the internal
+  // nodes, which are created in increasing frequency order
+  size_t leaf     = 0;
+  size_t internal = leaves;
+  size_t count    = leaves;
+  while(count < 2*leaves - 1)
+  {
+    int16_t pick[2];
+    for(size_t i = 0; i < 2; ++i)
+    {
+      if(leaf < leaves && (internal == count || nodes[leaf].freq <= nodes[internal].freq))
+        pick[i] = leaf++;
+      else
+        pick[i] = internal++;
+    }
+
+    nodes[count].freq  = nodes[pick[0]].freq + nodes[pick[1]].freq;
+    nodes[count].child = pick[0];
+    nodes[count].right = pick[1];
+    nodes[count].sym   = 0;
+    ++count;
+  }
+
+  uint8_t  tree[512];
+  uint64_t codes[256];
+  uint8_t  lens[256];
+
+  size_t root = count - 1;
+  if(!huff_layout(nodes, root, tree))
+  {
+    free(nodes);
+    return -1;
+  }
+
+  huff_codes(nodes, root, 0, 0, codes, lens);
+  free(nodes);
+
+  writer_t out = { output, outsize, 0 };
+  if(!writer_header(&out, DECOMPRESS_HUFF1 + bits - 1, insize))
+    return -1;
+
+  for(size_t i = 0; i < (((size_t)tree[0])+1)*2; ++i)
+  {
+    if(!writer_put(&out, tree[i]))
+      return -1;
+  }
+
+  // pack codes from bit 31 to bit 0 of little-endian words
+  uint32_t word = 0;
+  size_t   used = 0;
+  for(size_t i = 0; i < insize; ++i)
+  {
+    uint64_t code = codes[data[i]];
+    size_t   len  = lens[data[i]];
+
+    while(len > 0)
+    {
+      size_t take = 32 - used;
+      if(take > len)
+        take = len;
+
+      len  -= take;
+      used += take;
+      word |= ((uint32_t)(code >> len) & (0xFFFFFFFF >> (32 - take))) << (32 - used);
+
+      if(used == 32)
+      {
+        if(!huff_flush(&out, word))
+          return -1;
+
+        word = 0;
+        used = 0;
+      }
+    }
+  }
+
+  if(used > 0 && !huff_flush(&out, word))
+    return -1;
+
+  return out.pos;
+}
+
+ssize_t
+compressRLE(void *output, size_t outsize, const void *input, size_t insize)
+{
+  writer_t out = { output, outsize, 0 };
+  if(!writer_header(&out, DECOMPRESS_RLE, insize))
+    return -1;
+
+  const uint8_t *data = (const uint8_t*)input;
+  size_t        pos   = 0;
+
+  while(pos < insize)
+  {
+    // measure the run at this position
+    size_t len = 1;
+    while(pos + len < insize && len < 0x82 && data[pos + len] == data[pos])
+      ++len;
+
+    if(len >= 3) // compressed block
+    {
+      if(!writer_put(&out, 0x80 | (len - 3))
+      || !writer_put(&out, data[pos]))
+        return -1;
+
+      pos += len;
+      continue;
+    }
+
+    // uncompressed block, up to the start of the next run
+    len = 0;
+    while(pos + len < insize && len < 0x80)
+    {
+      if(pos + len + 2 < insize
+      && data[pos + len] == data[pos + len + 1]
+      && data[pos + len] == data[pos + len + 2])
+        break;
+
+      ++len;
+    }
+
+    if(!writer_put(&out, len - 1))
+      return -1;
+
+    for(size_t i = 0; i < len; ++i)
+    {
+      if(!writer_put(&out, data[pos++]))
+        return -1;
+    }
+  }
+
+  return out.pos;
+}
+
+size_t
+compressMaxSize(decompressType type, size_t size)
+{
+  size_t header = size > 0xFFFFFF ? 8 : 4;
+
+  switch(type)
+  {
+    case DECOMPRESS_DUMMY:
+      return header + size;
+
+    case DECOMPRESS_LZSS:
+    case DECOMPRESS_LZ11:
+      // one flags byte per eight uncompressed blocks
+      return header + size + (size + 7) / 8;
+
+    case DECOMPRESS_HUFF1:
+    case DECOMPRESS_HUFF2:
+    case DECOMPRESS_HUFF3:
+    case DECOMPRESS_HUFF4:
+    case DECOMPRESS_HUFF5:
+    case DECOMPRESS_HUFF6:
+    case DECOMPRESS_HUFF7:
+    case DECOMPRESS_HUFF8:
+    {
+      // huffman codes average at most the data size in bits
+      size_t bits  = type & 0xF;
+      size_t words = (size / 32) * bits + ((size % 32) * bits + 31) / 32;
+      return header + 512 + words * 4;
+    }
+
+    case DECOMPRESS_RLE:
+      // one header byte per 128 uncompressed bytes
+      return header + size + (size + 127) / 128;
+  }
+
+  return 0;
+}
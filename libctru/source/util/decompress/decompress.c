@@ -11,6 +11,12 @@
 
 #define BUFFERSIZE 16384
 
+#define HUFF_TABLEBITS 9      ///< Huffman lookup table index size in bits
+#define HUFF_MAXSYMS   4      ///< Max symbols decoded per table lookup
+#define HUFF_BADNODE   0xFFFF ///< Marker for a malformed Huffman tree
+
+#define STREAM_WINDOW  4096   ///< LZ sliding window size
+
 /** @brief Buffer */
 typedef struct buffer_t
 {
@@ -154,6 +160,16 @@ buffer_get(buffer_t *buffer, uint8_t *dest, decompressCallback callback,
   return buffer_read(buffer, dest, sizeof(*dest), callback, userdata);
 }
 
+/*! Skip empty buffers at the iterator position
+ *  @param[in] it I/O vector iterator
+ */
+static inline void
+iov_skip_empty(iov_iter *it)
+{
+  while(it->num < it->cnt && it->iov[it->num].size == 0)
+    ++it->num;
+}
+
 /*! Create I/O vector iterator
  *  @param[in] iov I/O vector
  *  @param[in] iovcnt Number of buffers
@@ -167,6 +183,7 @@ iov_begin(const decompressIOVec *iov, size_t iovcnt)
   it.cnt = iovcnt;
   it.num = 0;
   it.pos = 0;
+  iov_skip_empty(&it);
 
   return it;
 }
@@ -219,6 +236,7 @@ iov_increment(iov_iter *it)
     // advance to next buffer
     it->pos = 0;
     ++it->num;
+    iov_skip_empty(it);
   }
 }
 
@@ -244,6 +262,7 @@ iov_add(iov_iter *it, size_t size)
     // advance to next buffer
     size -= it->iov[it->num].size - it->pos;
     ++it->num;
+    iov_skip_empty(it);
     assert(size == 0 || it->num < it->cnt);
     it->pos = 0;
   }
@@ -360,6 +379,7 @@ static bool
 decompress_lzss(buffer_t *buffer, const decompressIOVec *iov, size_t iovcnt,
                 size_t size, decompressCallback callback, void *userdata)
 {
+  const size_t total = size;
   iov_iter     out = iov_begin(iov, iovcnt);
   uint8_t      flags = 0;
   uint8_t      mask  = 0;
@@ -392,6 +412,10 @@ decompress_lzss(buffer_t *buffer, const decompressIOVec *iov, size_t iovcnt,
       disp = displen[0] & 0x0F;
       disp = disp << 8 | displen[1];
 
+      // reject references before the start of the output
+      if(disp+1 > total - size)
+        return false;
+
       if(len > size)
         len = size;
 
@@ -430,9 +454,10 @@ static bool
 decompress_lz11(buffer_t *buffer, const decompressIOVec *iov, size_t iovcnt,
                 size_t size, decompressCallback callback, void *userdata)
 {
-  iov_iter out = iov_begin(iov, iovcnt);
-  int      i;
-  uint8_t  flags;
+  const size_t total = size;
+  iov_iter     out = iov_begin(iov, iovcnt);
+  int          i;
+  uint8_t      flags;
 
   while(size > 0)
   {
@@ -489,6 +514,10 @@ decompress_lz11(buffer_t *buffer, const decompressIOVec *iov, size_t iovcnt,
         disp  = (displen[pos++] & 0x0F) << 8;
         disp |= displen[pos];
 
+        // reject references before the start of the output
+        if(disp+1 > total - size)
+          return false;
+
         if(len > size)
           len = size;
 
@@ -513,6 +542,358 @@ decompress_lz11(buffer_t *buffer, const decompressIOVec *iov, size_t iovcnt,
   return true;
 }
 
+/** @brief Copy an LZ back-reference within contiguous memory
+ *  @param[in] out  Output position
+ *  @param[in] disp Distance back to the source (at least 1)
+ *  @param[in] len  Length to copy
+ */
+static inline void
+lz_copy(uint8_t *out, size_t disp, size_t len)
+{
+  const uint8_t *in = out - disp;
+
+  if(disp >= len)
+  {
+    // source and destination don't overlap
+    memcpy(out, in, len);
+    return;
+  }
+
+  if(disp >= sizeof(uint32_t))
+  {
+    // each word is fully written before it is read back
+    while(len >= sizeof(uint32_t))
+    {
+      uint32_t word;
+      memcpy(&word, in, sizeof(word));
+      memcpy(out, &word, sizeof(word));
+
+      in  += sizeof(word);
+      out += sizeof(word);
+      len -= sizeof(word);
+    }
+  }
+
+  while(len-- > 0)
+    *out++ = *in++;
+}
+
+/** @brief Decompress LZSS/LZ10 from contiguous memory
+ *  @param[in] out    Output buffer
+ *  @param[in] size   Output size limit
+ *  @param[in] in     Input buffer
+ *  @param[in] insize Input size
+ *  @returns Whether succeeded
+ */
+static bool
+decompress_lzss_mem(uint8_t *out, size_t size, const uint8_t *in, size_t insize)
+{
+  uint8_t       *const start = out;
+  uint8_t       *const end   = out + size;
+  const uint8_t *const inend = in + insize;
+
+  while(out < end)
+  {
+    // read in the flags data
+    // from bit 7 to bit 0:
+    //     0: raw byte
+    //     1: compressed block
+    if(in == inend)
+      return false;
+    uint8_t flags = *in++;
+
+    if(flags == 0 && end - out >= 8 && inend - in >= 8)
+    {
+      // eight raw bytes
+      memcpy(out, in, 8);
+      out += 8;
+      in  += 8;
+      continue;
+    }
+
+    for(uint8_t mask = 0x80; mask != 0 && out < end; mask >>= 1)
+    {
+      if(flags & mask) // compressed block
+      {
+        if(inend - in < 2)
+          return false;
+
+        // disp: displacement
+        // len:  length
+        size_t len  = (in[0] >> 4) + 3;
+        size_t disp = ((in[0] & 0x0F) << 8 | in[1]) + 1;
+        in += 2;
+
+        if(disp > (size_t)(out - start))
+          return false;
+
+        if(len > (size_t)(end - out))
+          len = end - out;
+
+        lz_copy(out, disp, len);
+        out += len;
+      }
+      else // uncompressed block
+      {
+        // copy a raw byte from the input to the output
+        if(in == inend)
+          return false;
+
+        *out++ = *in++;
+      }
+    }
+  }
+
+  return true;
+}
+
+/** @brief Decompress LZ11 from contiguous memory
+ *  @param[in] out    Output buffer
+ *  @param[in] size   Output size limit
+ *  @param[in] in     Input buffer
+ *  @param[in] insize Input size
+ *  @returns Whether succeeded
+ */
+static bool
+decompress_lz11_mem(uint8_t *out, size_t size, const uint8_t *in, size_t insize)
+{
+  uint8_t       *const start = out;
+  uint8_t       *const end   = out + size;
+  const uint8_t *const inend = in + insize;
+
+  while(out < end)
+  {
+    // read in the flags data
+    // from bit 7 to bit 0, following blocks:
+    //     0: raw byte
+    //     1: compressed block
+    if(in == inend)
+      return false;
+    uint8_t flags = *in++;
+
+    if(flags == 0 && end - out >= 8 && inend - in >= 8)
+    {
+      // eight raw bytes
+      memcpy(out, in, 8);
+      out += 8;
+      in  += 8;
+      continue;
+    }
+
+    for(int i = 0; i < 8 && out < end; i++, flags <<= 1)
+    {
+      if(flags & 0x80) // compressed block
+      {
+        if(in == inend)
+          return false;
+
+        size_t len;  // length
+        size_t disp; // displacement
+
+        switch(in[0] >> 4)
+        {
+          case 0: // extended block
+            if(inend - in < 3)
+              return false;
+
+            len  = in[0] << 4;
+            len |= in[1] >> 4;
+            len += 0x11;
+            in  += 1;
+            break;
+
+          case 1: // extra extended block
+            if(inend - in < 4)
+              return false;
+
+            len  = (in[0] & 0x0F) << 12;
+            len |= in[1] << 4;
+            len |= in[2] >> 4;
+            len += 0x111;
+            in  += 2;
+            break;
+
+          default: // normal block
+            if(inend - in < 2)
+              return false;
+
+            len = (in[0] >> 4) + 1;
+            break;
+        }
+
+        disp = ((in[0] & 0x0F) << 8 | in[1]) + 1;
+        in  += 2;
+
+        if(disp > (size_t)(out - start))
+          return false;
+
+        if(len > (size_t)(end - out))
+          len = end - out;
+
+        lz_copy(out, disp, len);
+        out += len;
+      }
+      else // uncompressed block
+      {
+        // copy a raw byte from the input to the output
+        if(in == inend)
+          return false;
+
+        *out++ = *in++;
+      }
+    }
+  }
+
+  return true;
+}
+
+/** @brief Huffman lookup table entry */
+typedef struct
+{
+  uint8_t  sym[HUFF_MAXSYMS];  ///< Decoded symbols
+  uint8_t  bits[HUFF_MAXSYMS]; ///< Bits consumed after each symbol
+  uint8_t  count;              ///< Number of decoded symbols
+  uint16_t node;               ///< Node reached if no symbol was decoded
+} huff_entry;
+
+/** @brief Huffman decoder state */
+typedef struct
+{
+  const uint8_t *tree;  ///< Huffman tree
+  size_t        size;   ///< Huffman tree size
+  uint8_t       mask;   ///< Mask to apply to data
+  uint32_t      word;   ///< Input bitstream, next bit in bit 31
+  size_t        avail;  ///< Bits remaining in word
+  huff_entry    *table; ///< Lookup table
+} huff_state;
+
+/** @brief Walk one bit down the Huffman tree
+ *  @param[in]  huff Huffman decoder state
+ *  @param[in]  node Current node
+ *  @param[in]  bit  Bit to follow
+ *  @param[out] sym  Decoded symbol if a data node was reached
+ *  @returns Next node
+ *  @retval 0 data node was reached
+ *  @retval HUFF_BADNODE tree is malformed
+ */
+static inline size_t
+huff_walk(const huff_state *huff, size_t node, bool bit, uint8_t *sym)
+{
+  // read the current node's offset value
+  size_t child = (node & ~1) + (huff->tree[node] & 0x3F)*2 + 2 + bit;
+  if(child >= huff->size)
+    return HUFF_BADNODE;
+
+  // the "left" data flag is bit 7, the "right" data flag is bit 6
+  if(huff->tree[node] & (0x80 >> bit))
+  {
+    // copy the child node into the output and apply mask
+    *sym = huff->tree[child] & huff->mask;
+    return 0;
+  }
+
+  return child;
+}
+
+/** @brief Build Huffman lookup table
+ *  @param[in] huff Huffman decoder state
+ *
+ *  Each entry decodes up to HUFF_MAXSYMS symbols from the HUFF_TABLEBITS-bit
+ *  index. If the first code is longer than the index, the entry records the
+ *  node reached after consuming the whole index instead.
+ */
+static void
+huff_build(huff_state *huff)
+{
+  for(size_t i = 0; i < (1 << HUFF_TABLEBITS); ++i)
+  {
+    huff_entry *entry = &huff->table[i];
+    size_t     node   = 1;
+
+    entry->count = 0;
+    entry->node  = 1;
+
+    for(size_t bit = 0; bit < HUFF_TABLEBITS; ++bit)
+    {
+      uint8_t sym = 0;
+      node = huff_walk(huff, node, (i >> (HUFF_TABLEBITS-1-bit)) & 1, &sym);
+      if(node == HUFF_BADNODE)
+        break;
+
+      if(node == 0)
+      {
+        entry->sym[entry->count]    = sym;
+        entry->bits[entry->count++] = bit + 1;
+        if(entry->count == HUFF_MAXSYMS)
+          break;
+
+        // start over at the root node
+        node = 1;
+      }
+    }
+
+    if(entry->count == 0)
+      entry->node = node;
+  }
+}
+
+/** @brief Fetch the next 32 bits of Huffman input
+ *  @param[in] huff     Huffman decoder state
+ *  @param[in] buffer   Decompression buffer object
+ *  @param[in] callback Data callback
+ *  @param[in] userdata User data passed to callback
+ *  @returns Whether succeeded
+ */
+static inline bool
+huff_fetch(huff_state *huff, buffer_t *buffer, decompressCallback callback,
+           void *userdata)
+{
+  uint8_t wordbuf[4];
+  if(!buffer_get(buffer, &wordbuf[0], callback, userdata)
+  || !buffer_get(buffer, &wordbuf[1], callback, userdata)
+  || !buffer_get(buffer, &wordbuf[2], callback, userdata)
+  || !buffer_get(buffer, &wordbuf[3], callback, userdata))
+    return false;
+
+  huff->word = (wordbuf[0] <<  0)
+             | (wordbuf[1] <<  8)
+             | (wordbuf[2] << 16)
+             | ((uint32_t)wordbuf[3] << 24);
+  huff->avail = 32;
+
+  return true;
+}
+
+/** @brief Decode one symbol a bit at a time
+ *  @param[in]  huff     Huffman decoder state
+ *  @param[in]  node     Node to start from
+ *  @param[out] sym      Decoded symbol
+ *  @param[in]  buffer   Decompression buffer object
+ *  @param[in]  callback Data callback
+ *  @param[in]  userdata User data passed to callback
+ *  @returns Whether succeeded
+ */
+static bool
+huff_slow(huff_state *huff, size_t node, uint8_t *sym, buffer_t *buffer,
+          decompressCallback callback, void *userdata)
+{
+  while(node != 0)
+  {
+    if(node == HUFF_BADNODE)
+      return false;
+
+    if(huff->avail == 0 && !huff_fetch(huff, buffer, callback, userdata))
+      return false;
+
+    // read bit 31 to bit 0
+    node = huff_walk(huff, node, huff->word >> 31, sym);
+    huff->word <<= 1;
+    --huff->avail;
+  }
+
+  return true;
+}
+
 /** @brief Decompress Huffman
  *  @param[in] bits     Data size in bits (usually 4 or 8)
  *  @param[in] buffer   Decompression buffer object
@@ -531,7 +912,7 @@ decompress_huff(const size_t bits, buffer_t *buffer, const decompressIOVec *iov,
   if(bits < 1 || bits > 8)
     return false;
 
-  uint8_t *tree = (uint8_t*)malloc(512);
+  uint8_t *tree = (uint8_t*)malloc(512 + (1 << HUFF_TABLEBITS) * sizeof(huff_entry));
   if(!tree)
     return false;
 
@@ -549,84 +930,63 @@ decompress_huff(const size_t bits, buffer_t *buffer, const decompressIOVec *iov,
     return false;
   }
 
-  iov_iter out = iov_begin(iov, iovcnt);
-  uint32_t word = 0;               // 32-bits of input bitstream
-  uint32_t mask = 0;               // which bit we are reading
-  uint8_t  dataMask = (1<<bits)-1; // mask to apply to data
-  size_t   node;                   // node in the huffman tree
-  size_t   child;                  // child of a node
-  uint32_t offset;                 // offset from node to child
+  huff_state huff;
+  huff.tree  = tree;
+  huff.size  = (((size_t)tree[0])+1)*2;
+  huff.mask  = (1<<bits)-1;
+  huff.word  = 0;
+  huff.avail = 0;
+  huff.table = (huff_entry*)(tree + 512);
 
-  // point to the root of the huffman tree
-  node = 1;
+  huff_build(&huff);
+
+  iov_iter out = iov_begin(iov, iovcnt);
 
   while(size > 0)
   {
-    if(mask == 0) // we exhausted 32 bits
+    if(huff.avail == 0 && !huff_fetch(&huff, buffer, callback, userdata))
     {
-      // reset the mask
-      mask = 0x80000000;
-
-      // read the next 32 bits
-      uint8_t wordbuf[4];
-      if(!buffer_get(buffer, &wordbuf[0], callback, userdata)
-      || !buffer_get(buffer, &wordbuf[1], callback, userdata)
-      || !buffer_get(buffer, &wordbuf[2], callback, userdata)
-      || !buffer_get(buffer, &wordbuf[3], callback, userdata))
-      {
-        free(tree);
-        return false;
-      }
-
-      word = (wordbuf[0] <<  0)
-           | (wordbuf[1] <<  8)
-           | (wordbuf[2] << 16)
-           | (wordbuf[3] << 24);
+      free(tree);
+      return false;
     }
 
-    // read the current node's offset value
-    offset = tree[node] & 0x3F;
-
-    child = (node & ~1) + offset*2 + 2;
+    // consumed bits are shifted out, so a short word is zero-padded; only
+    // symbols which fit in the remaining bits are valid
+    const huff_entry *entry = &huff.table[huff.word >> (32 - HUFF_TABLEBITS)];
+    size_t           count  = 0;
 
-    if(word & mask) // we read a 1
+    while(count < entry->count && count < size
+       && entry->bits[count] <= huff.avail)
     {
-      // point to the "right" child
-      ++child;
-
-      if(tree[node] & 0x40) // "right" child is a data node
-      {
-        // copy the child node into the output buffer and apply mask
-        *iov_addr(&out) = tree[child] & dataMask;
-        iov_increment(&out);
-        --size;
-
-        // start over at the root node
-        node = 1;
-      }
-      else // traverse to the "right" child
-        node = child;
+      *iov_addr(&out) = entry->sym[count++];
+      iov_increment(&out);
     }
-    else // we read a 0
+
+    if(count > 0)
     {
-      // pointed to the "left" child
+      size       -= count;
+      huff.word <<= entry->bits[count-1];
+      huff.avail -= entry->bits[count-1];
+      continue;
+    }
 
-      if(tree[node] & 0x80) // "left" child is a data node
-      {
-        // copy the child node into the output buffer and apply mask
-        *iov_addr(&out) = tree[child] & dataMask;
-        iov_increment(&out);
-        --size;
+    // the code is longer than the table or crosses into the next word
+    size_t node = 1;
+    if(entry->count == 0 && huff.avail >= HUFF_TABLEBITS)
+    {
+      node        = entry->node;
+      huff.word <<= HUFF_TABLEBITS;
+      huff.avail -= HUFF_TABLEBITS;
+    }
 
-        // start over at the root node
-        node = 1;
-      }
-      else // traverse to the "left" child
-        node = child;
+    if(!huff_slow(&huff, node, iov_addr(&out), buffer, callback, userdata))
+    {
+      free(tree);
+      return false;
     }
 
-    // shift to read next bit (read bit 31 to bit 0)
-    mask >>= 1;
+    iov_increment(&out);
+    --size;
   }
 
   free(tree);
@@ -692,6 +1052,360 @@ decompress_rle(buffer_t *buffer, const decompressIOVec *iov, size_t iovcnt,
   return true;
 }
 
+/** @brief Streaming decoder states */
+typedef enum
+{
+  STREAM_HEADER, ///< Reading compression header
+  STREAM_TREE,   ///< Reading Huffman tree
+  STREAM_DATA,   ///< Decoding data
+  STREAM_DONE,   ///< Output complete
+  STREAM_ERROR,  ///< Stream is malformed
+} stream_state;
+
+/** @brief Streaming decompression context */
+struct decompressStream
+{
+  stream_state   state;    ///< Decoder state
+  decompressType type;     ///< Compression type
+  size_t         length;   ///< Decompressed size
+  size_t         size;     ///< Remaining output size
+  size_t         total;    ///< LZ output produced so far
+  uint8_t        token[8]; ///< Partially read header, token or word
+  size_t         count;    ///< Bytes held in token
+  uint8_t        flags;    ///< LZ flags
+  uint8_t        mask;     ///< LZ flags mask
+  size_t         len;      ///< Pending copy, run or literal length
+  size_t         disp;     ///< Pending back-reference distance
+  bool           run;      ///< Whether the pending RLE block is a run
+  uint8_t        byte;     ///< RLE run byte
+  size_t         node;     ///< Huffman node of a partially decoded code
+  huff_state     huff;     ///< Huffman decoder state
+
+  uint8_t    tree[512];                  ///< Huffman tree
+  huff_entry table[1 << HUFF_TABLEBITS]; ///< Huffman lookup table
+  uint8_t    window[STREAM_WINDOW];      ///< LZ sliding window
+};
+
+/** @brief Streaming I/O cursor */
+typedef struct
+{
+  const uint8_t *in;     ///< Input position
+  const uint8_t *inend;  ///< End of input
+  uint8_t       *out;    ///< Output position
+  uint8_t       *outend; ///< End of output
+} stream_io;
+
+/** @brief Accumulate input until a given amount is buffered
+ *  @param[in] stream Streaming decompression context
+ *  @param[in] io     Streaming I/O cursor
+ *  @param[in] dest   Accumulation buffer
+ *  @param[in] need   Amount required in dest
+ *  @returns Whether dest holds need bytes
+ *
+ *  @note The caller resets stream->count once it has consumed dest.
+ */
+static inline bool
+stream_gather(decompressStream *stream, stream_io *io, uint8_t *dest,
+              size_t need)
+{
+  if(stream->count >= need)
+    return true;
+
+  size_t bytes = need - stream->count;
+  if(bytes > (size_t)(io->inend - io->in))
+    bytes = io->inend - io->in;
+
+  memcpy(dest + stream->count, io->in, bytes);
+  io->in        += bytes;
+  stream->count += bytes;
+
+  return stream->count == need;
+}
+
+/** @brief Emit an LZ output byte
+ *  @param[in] stream Streaming decompression context
+ *  @param[in] io     Streaming I/O cursor
+ *  @param[in] byte   Byte to emit
+ */
+static inline void
+stream_put(decompressStream *stream, stream_io *io, uint8_t byte)
+{
+  stream->window[stream->total++ & (STREAM_WINDOW-1)] = byte;
+  *io->out++ = byte;
+  --stream->size;
+}
+
+/** @brief Drain a pending LZ back-reference
+ *  @param[in] stream Streaming decompression context
+ *  @param[in] io     Streaming I/O cursor
+ *  @returns Whether the back-reference is complete
+ */
+static inline bool
+stream_copy(decompressStream *stream, stream_io *io)
+{
+  while(stream->len > 0)
+  {
+    if(io->out == io->outend)
+      return false;
+
+    stream_put(stream, io,
+               stream->window[(stream->total - stream->disp) & (STREAM_WINDOW-1)]);
+    --stream->len;
+  }
+
+  return true;
+}
+
+/** @brief Stream LZSS/LZ10 and LZ11
+ *  @param[in] stream Streaming decompression context
+ *  @param[in] io     Streaming I/O cursor
+ *  @returns Decoder status
+ */
+static decompressStreamStatus
+stream_lz(decompressStream *stream, stream_io *io)
+{
+  while(true)
+  {
+    if(!stream_copy(stream, io))
+      return DECOMPRESS_STREAM_MORE;
+
+    if(stream->size == 0)
+      return DECOMPRESS_STREAM_DONE;
+
+    if(stream->mask == 0)
+    {
+      // read in the flags data
+      // from bit 7 to bit 0:
+      //     0: raw byte
+      //     1: compressed block
+      if(io->in == io->inend)
+        return DECOMPRESS_STREAM_MORE;
+
+      stream->flags = *io->in++;
+      stream->mask  = 0x80;
+    }
+
+    if(stream->flags & stream->mask) // compressed block
+    {
+      uint8_t *displen = stream->token;
+      size_t  pos      = 0;
+
+      if(stream->type == DECOMPRESS_LZSS)
+      {
+        if(!stream_gather(stream, io, displen, 2))
+          return DECOMPRESS_STREAM_MORE;
+
+        stream->len = (displen[0] >> 4) + 3;
+      }
+      else
+      {
+        if(!stream_gather(stream, io, displen, 1))
+          return DECOMPRESS_STREAM_MORE;
+
+        switch(displen[0] >> 4)
+        {
+          case 0: // extended block
+            if(!stream_gather(stream, io, displen, 3))
+              return DECOMPRESS_STREAM_MORE;
+
+            stream->len  = displen[pos++] << 4;
+            stream->len |= displen[pos] >> 4;
+            stream->len += 0x11;
+            break;
+
+          case 1: // extra extended block
+            if(!stream_gather(stream, io, displen, 4))
+              return DECOMPRESS_STREAM_MORE;
+
+            stream->len  = (displen[pos++] & 0x0F) << 12;
+            stream->len |= displen[pos++] << 4;
+            stream->len |= displen[pos] >> 4;
+            stream->len += 0x111;
+            break;
+
+          default: // normal block
+            if(!stream_gather(stream, io, displen, 2))
+              return DECOMPRESS_STREAM_MORE;
+
+            stream->len = (displen[pos] >> 4) + 1;
+            break;
+        }
+      }
+
+      stream->count = 0;
+      stream->disp  = ((displen[pos] & 0x0F) << 8 | displen[pos+1]) + 1;
+      if(stream->disp > stream->total)
+        return DECOMPRESS_STREAM_ERROR;
+
+      if(stream->len > stream->size)
+        stream->len = stream->size;
+    }
+    else // uncompressed block
+    {
+      if(io->out == io->outend || io->in == io->inend)
+        return DECOMPRESS_STREAM_MORE;
+
+      // copy a raw byte from the input to the output
+      stream_put(stream, io, *io->in++);
+    }
+
+    stream->mask >>= 1;
+  }
+}
+
+/** @brief Stream Huffman
+ *  @param[in] stream Streaming decompression context
+ *  @param[in] io     Streaming I/O cursor
+ *  @returns Decoder status
+ */
+static decompressStreamStatus
+stream_huff(decompressStream *stream, stream_io *io)
+{
+  huff_state *huff = &stream->huff;
+
+  while(stream->size > 0)
+  {
+    if(io->out == io->outend)
+      return DECOMPRESS_STREAM_MORE;
+
+    if(stream->node == 1)
+    {
+      if(huff->avail == 0)
+      {
+        // read the next 32 bits
+        if(!stream_gather(stream, io, stream->token, 4))
+          return DECOMPRESS_STREAM_MORE;
+
+        stream->count = 0;
+        huff->word    = (stream->token[0] <<  0)
+                      | (stream->token[1] <<  8)
+                      | (stream->token[2] << 16)
+                      | ((uint32_t)stream->token[3] << 24);
+        huff->avail   = 32;
+      }
+
+      const huff_entry *entry = &huff->table[huff->word >> (32 - HUFF_TABLEBITS)];
+      size_t           count  = 0;
+
+      while(count < entry->count && count < stream->size
+         && io->out + count < io->outend && entry->bits[count] <= huff->avail)
+      {
+        io->out[count] = entry->sym[count];
+        ++count;
+      }
+
+      if(count > 0)
+      {
+        io->out      += count;
+        stream->size -= count;
+        huff->word  <<= entry->bits[count-1];
+        huff->avail  -= entry->bits[count-1];
+        continue;
+      }
+
+      // the code is longer than the table or crosses into the next word
+      if(entry->count == 0 && huff->avail >= HUFF_TABLEBITS)
+      {
+        stream->node = entry->node;
+        huff->word <<= HUFF_TABLEBITS;
+        huff->avail -= HUFF_TABLEBITS;
+      }
+    }
+
+    // walk the rest of the code a bit at a time
+    do
+    {
+      if(stream->node == HUFF_BADNODE)
+        return DECOMPRESS_STREAM_ERROR;
+
+      if(huff->avail == 0)
+      {
+        if(!stream_gather(stream, io, stream->token, 4))
+          return DECOMPRESS_STREAM_MORE;
+
+        stream->count = 0;
+        huff->word    = (stream->token[0] <<  0)
+                      | (stream->token[1] <<  8)
+                      | (stream->token[2] << 16)
+                      | ((uint32_t)stream->token[3] << 24);
+        huff->avail   = 32;
+      }
+
+      stream->node = huff_walk(huff, stream->node, huff->word >> 31, io->out);
+      huff->word <<= 1;
+      --huff->avail;
+    } while(stream->node != 0);
+
+    ++io->out;
+    --stream->size;
+    stream->node = 1;
+  }
+
+  return DECOMPRESS_STREAM_DONE;
+}
+
+/** @brief Stream run-length encoding
+ *  @param[in] stream Streaming decompression context
+ *  @param[in] io     Streaming I/O cursor
+ *  @returns Decoder status
+ */
+static decompressStreamStatus
+stream_rle(decompressStream *stream, stream_io *io)
+{
+  while(true)
+  {
+    while(stream->len > 0)
+    {
+      size_t bytes = io->outend - io->out;
+      if(!stream->run && bytes > (size_t)(io->inend - io->in))
+        bytes = io->inend - io->in;
+      if(bytes > stream->len)
+        bytes = stream->len;
+
+      if(bytes == 0)
+        return DECOMPRESS_STREAM_MORE;
+
+      // for len, copy byte or input into output
+      if(stream->run)
+        memset(io->out, stream->byte, bytes);
+      else
+      {
+        memcpy(io->out, io->in, bytes);
+        io->in += bytes;
+      }
+
+      io->out     += bytes;
+      stream->len -= bytes;
+    }
+
+    if(stream->size == 0)
+      return DECOMPRESS_STREAM_DONE;
+
+    // read in the data header
+    if(!stream_gather(stream, io, stream->token, 1))
+      return DECOMPRESS_STREAM_MORE;
+
+    stream->run = stream->token[0] & 0x80;
+    if(stream->run) // compressed block
+    {
+      // read in the byte used for the run
+      if(!stream_gather(stream, io, stream->token, 2))
+        return DECOMPRESS_STREAM_MORE;
+
+      stream->len  = (stream->token[0] & 0x7F) + 3;
+      stream->byte = stream->token[1];
+    }
+    else // uncompressed block
+      stream->len = (stream->token[0] & 0x7F) + 1;
+
+    stream->count = 0;
+    if(stream->len > stream->size)
+      stream->len = stream->size;
+
+    stream->size -= stream->len;
+  }
+}
+
 ssize_t
 decompressCallback_FD(void *userdata, void *buffer, size_t size)
 {
@@ -710,8 +1424,9 @@ ssize_t
 decompressHeader(decompressType *type, size_t *size,
                  decompressCallback callback, void *userdata, size_t insize)
 {
+  // fetch a byte at a time so that nothing past the header is consumed
   buffer_t buffer;
-  uint8_t bufferdata[4];
+  uint8_t bufferdata[1];
   if(!callback)
     buffer_memory(&buffer, userdata, insize);
   else
@@ -734,7 +1449,7 @@ decompressHeader(decompressType *type, size_t *size,
       return -1;
 
     bytes += 4;
-    outsize |= header[0] << 24;
+    outsize |= (size_t)header[0] << 24;
   }
 
   if(type)
@@ -783,11 +1498,17 @@ decompressV(const decompressIOVec *iov, size_t iovcnt,
     }
 
     case DECOMPRESS_LZSS:
-      result = decompress_lzss(&buffer, iov, iovcnt, size, callback, userdata);
+      if(!callback && iovcnt == 1)
+        result = decompress_lzss_mem(iov->data, size, buffer.data, buffer.size);
+      else
+        result = decompress_lzss(&buffer, iov, iovcnt, size, callback, userdata);
       break;
 
     case DECOMPRESS_LZ11:
-      result = decompress_lz11(&buffer, iov, iovcnt, size, callback, userdata);
+      if(!callback && iovcnt == 1)
+        result = decompress_lz11_mem(iov->data, size, buffer.data, buffer.size);
+      else
+        result = decompress_lz11(&buffer, iov, iovcnt, size, callback, userdata);
       break;
 
     case DECOMPRESS_HUFF1:
@@ -816,6 +1537,9 @@ bool
 decompressV_LZSS(const decompressIOVec *iov, size_t iovcnt,
                  decompressCallback callback, void *userdata, size_t insize)
 {
+  if(!callback && iovcnt == 1)
+    return decompress_lzss_mem(iov->data, iov->size, userdata, insize);
+
   buffer_t buffer;
   if(!callback)
     buffer_memory(&buffer, userdata, insize);
@@ -834,6 +1558,9 @@ bool
 decompressV_LZ11(const decompressIOVec *iov, size_t iovcnt,
                  decompressCallback callback, void *userdata, size_t insize)
 {
+  if(!callback && iovcnt == 1)
+    return decompress_lz11_mem(iov->data, iov->size, userdata, insize);
+
   buffer_t buffer;
   if(!callback)
     buffer_memory(&buffer, userdata, insize);
@@ -848,6 +1575,20 @@ decompressV_LZ11(const decompressIOVec *iov, size_t iovcnt,
   return result;
 }
 
+bool
+decompress_LZSS_mem(void *output, size_t size, const void *input,
+                    size_t insize)
+{
+  return decompress_lzss_mem(output, size, input, insize);
+}
+
+bool
+decompress_LZ11_mem(void *output, size_t size, const void *input,
+                    size_t insize)
+{
+  return decompress_lz11_mem(output, size, input, insize);
+}
+
 bool
 decompressV_Huff(size_t bits, const decompressIOVec *iov, size_t iovcnt,
                  decompressCallback callback, void *userdata, size_t insize)
@@ -883,3 +1624,193 @@ decompressV_RLE(const decompressIOVec *iov, size_t iovcnt,
     buffer_destroy(&buffer);
   return result;
 }
+
+decompressStream*
+decompressStreamCreate(void)
+{
+  decompressStream *stream = (decompressStream*)malloc(sizeof(*stream));
+  if(!stream)
+    return NULL;
+
+  decompressStreamReset(stream);
+  return stream;
+}
+
+void
+decompressStreamReset(decompressStream *stream)
+{
+  stream->state  = STREAM_HEADER;
+  stream->type   = DECOMPRESS_DUMMY;
+  stream->length = 0;
+  stream->size   = 0;
+  stream->total  = 0;
+  stream->count  = 0;
+  stream->flags  = 0;
+  stream->mask   = 0;
+  stream->len    = 0;
+  stream->disp   = 0;
+  stream->run    = false;
+  stream->byte   = 0;
+  stream->node   = 1;
+}
+
+void
+decompressStreamFree(decompressStream *stream)
+{
+  free(stream);
+}
+
+bool
+decompressStreamHeader(const decompressStream *stream, decompressType *type,
+                       size_t *size)
+{
+  if(stream->state == STREAM_HEADER || stream->state == STREAM_ERROR)
+    return false;
+
+  if(type)
+    *type = stream->type;
+  if(size)
+    *size = stream->length;
+
+  return true;
+}
+
+decompressStreamStatus
+decompressStreamRun(decompressStream *stream, const void *input, size_t insize,
+                    size_t *inused, void *output, size_t outsize,
+                    size_t *outused)
+{
+  stream_io io;
+  io.in     = (const uint8_t*)input;
+  io.inend  = io.in + insize;
+  io.out    = (uint8_t*)output;
+  io.outend = io.out + outsize;
+
+  decompressStreamStatus status = DECOMPRESS_STREAM_MORE;
+
+  switch(stream->state)
+  {
+    case STREAM_HEADER:
+    {
+      if(!stream_gather(stream, &io, stream->token, 4)
+      || ((stream->token[0] & 0x80) && !stream_gather(stream, &io, stream->token, 8)))
+        break;
+
+      stream->count = 0;
+      stream->type  = stream->token[0] & ~0x80;
+      stream->size  = ((size_t)stream->token[1] <<  0)
+                    | ((size_t)stream->token[2] <<  8)
+                    | ((size_t)stream->token[3] << 16);
+
+      if(stream->token[0] & 0x80)
+        stream->size |= (size_t)stream->token[4] << 24;
+
+      stream->length = stream->size;
+
+      switch(stream->type)
+      {
+        case DECOMPRESS_DUMMY:
+        case DECOMPRESS_LZSS:
+        case DECOMPRESS_LZ11:
+        case DECOMPRESS_RLE:
+          stream->state = STREAM_DATA;
+          break;
+
+        case DECOMPRESS_HUFF1:
+        case DECOMPRESS_HUFF2:
+        case DECOMPRESS_HUFF3:
+        case DECOMPRESS_HUFF4:
+        case DECOMPRESS_HUFF5:
+        case DECOMPRESS_HUFF6:
+        case DECOMPRESS_HUFF7:
+        case DECOMPRESS_HUFF8:
+          stream->state = STREAM_TREE;
+          break;
+
+        default:
+          stream->state = STREAM_ERROR;
+          break;
+      }
+
+      if(stream->state != STREAM_TREE)
+        break;
+    }
+    // fallthrough
+
+    case STREAM_TREE:
+    {
+      // get tree size, then read tree
+      if(!stream_gather(stream, &io, stream->tree, 1)
+      || !stream_gather(stream, &io, stream->tree, (((size_t)stream->tree[0])+1)*2))
+        break;
+
+      stream->count       = 0;
+      stream->huff.tree   = stream->tree;
+      stream->huff.size   = (((size_t)stream->tree[0])+1)*2;
+      stream->huff.mask   = (1<<(stream->type & 0xF))-1;
+      stream->huff.word   = 0;
+      stream->huff.avail  = 0;
+      stream->huff.table  = stream->table;
+      huff_build(&stream->huff);
+
+      stream->state = STREAM_DATA;
+      break;
+    }
+
+    default:
+      break;
+  }
+
+  if(stream->state == STREAM_DATA)
+  {
+    switch(stream->type)
+    {
+      case DECOMPRESS_DUMMY:
+      {
+        size_t bytes = io.outend - io.out;
+        if(bytes > (size_t)(io.inend - io.in))
+          bytes = io.inend - io.in;
+        if(bytes > stream->size)
+          bytes = stream->size;
+
+        memcpy(io.out, io.in, bytes);
+        io.in        += bytes;
+        io.out       += bytes;
+        stream->size -= bytes;
+
+        status = stream->size ? DECOMPRESS_STREAM_MORE : DECOMPRESS_STREAM_DONE;
+        break;
+      }
+
+      case DECOMPRESS_LZSS:
+      case DECOMPRESS_LZ11:
+        status = stream_lz(stream, &io);
+        break;
+
+      case DECOMPRESS_RLE:
+        status = stream_rle(stream, &io);
+        break;
+
+      default:
+        status = stream_huff(stream, &io);
+        break;
+    }
+
+    if(status == DECOMPRESS_STREAM_DONE)
+      stream->state = STREAM_DONE;
+    else if(status == DECOMPRESS_STREAM_ERROR)
+      stream->state = STREAM_ERROR;
+  }
+
+  if(stream->state == STREAM_DONE)
+    status = DECOMPRESS_STREAM_DONE;
+  else if(stream->state == STREAM_ERROR)
+    status = DECOMPRESS_STREAM_ERROR;
+
+  if(inused)
+    *inused = io.in - (const uint8_t*)input;
+  if(outused)
+    *outused = io.out - (uint8_t*)output;
+
+  return status;
+}
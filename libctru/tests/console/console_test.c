@@ -0,0 +1,343 @@
+/** @file console_test.c
+ *  @brief Host test and benchmark for the console glyph renderer
+ *
+ *  source/console.c is built into this file, so that its static renderer can
+ *  be called directly. The previous renderer, which tested every font bit
+ *  with a branch and stored one RGB565 pixel at a time, is kept here as the
+ *  reference: RGB565 output must match it byte for byte, and BGR8 and RGBA8
+ *  output must match its pixels widened to 8 bits per channel.
+ */
+#include "../../source/console.c"
+
+#include <stdbool.h>
+#include <time.h>
+
+#define SCREEN_COLUMNS 50       ///< Cells across the top screen
+#define SCREEN_ROWS    30       ///< Cells down either screen
+#define BENCH_CHARS    1500000  ///< Characters drawn per benchmark run
+#define BENCH_RUNS     9        ///< Runs per renderer, the fastest is reported
+
+static int failures;
+
+#define FAIL(...) \
+  do { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); ++failures; } while(0)
+
+unsigned char default_font_bin[256 * 8];
+const devoptab_t *devoptab_list[STD_ERR + 1];
+
+/** @brief Framebuffers, large enough for the top screen in RGBA8 */
+static u8 framebuffer[400 * 240 * 4] __attribute__((aligned(16)));
+static u16 reference[400 * 240] __attribute__((aligned(16)));
+
+// console.c calls into the rest of libctru when a console is initialized,
+// which never happens here
+void gfxSetScreenFormat(gfxScreen_t screen, GSPGPU_FramebufferFormat format) {}
+void gfxSetDoubleBuffering(gfxScreen_t screen, bool enable) {}
+void gfxSwapBuffersGpu(void) {}
+void gfxFlushBuffers(void) {}
+void gspWaitForEvent(GSPGPU_Event id, bool nextEvent) {}
+bool gfxIsWide(void) { return false; }
+Result svcOutputDebugString(const char* str, s32 length) { return 0; }
+
+u8*
+gfxGetFramebuffer(gfxScreen_t screen, gfx3dSide_t side, u16* width, u16* height)
+{
+  return framebuffer;
+}
+
+/** @brief The renderer as it was before the per-color pixel tables */
+static void
+previousRenderChar(PrintConsole* console, int x, int y, int glyph, u16 fg, u16 bg, int flags)
+{
+  u8 *fontdata = console->font.gfx + (8 * glyph);
+
+  u8 b1 = *(fontdata++);
+  u8 b2 = *(fontdata++);
+  u8 b3 = *(fontdata++);
+  u8 b4 = *(fontdata++);
+  u8 b5 = *(fontdata++);
+  u8 b6 = *(fontdata++);
+  u8 b7 = *(fontdata++);
+  u8 b8 = *(fontdata++);
+
+  if(flags & CONSOLE_UNDERLINE) b8 = 0xff;
+
+  if(flags & CONSOLE_CROSSED_OUT) b4 = 0xff;
+
+  u8 mask = 0x80;
+
+  x *= 8;
+  y *= 8;
+
+  u16 *screen = &console->frameBuffer[(x * 240) + (239 - (y + 7))];
+
+  for(int i = 0; i < 8; i++)
+  {
+    if(b8 & mask) { *(screen++) = fg; } else { *(screen++) = bg; }
+    if(b7 & mask) { *(screen++) = fg; } else { *(screen++) = bg; }
+    if(b6 & mask) { *(screen++) = fg; } else { *(screen++) = bg; }
+    if(b5 & mask) { *(screen++) = fg; } else { *(screen++) = bg; }
+    if(b4 & mask) { *(screen++) = fg; } else { *(screen++) = bg; }
+    if(b3 & mask) { *(screen++) = fg; } else { *(screen++) = bg; }
+    if(b2 & mask) { *(screen++) = fg; } else { *(screen++) = bg; }
+    if(b1 & mask) { *(screen++) = fg; } else { *(screen++) = bg; }
+    mask >>= 1;
+    screen += 240 - 8;
+  }
+}
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static u32
+rnd(void)
+{
+  static u32 state = 1;
+  state = state * 1103515245 + 12345;
+  return state >> 8;
+}
+
+static PrintConsole
+make_console(GSPGPU_FramebufferFormat format, void *buffer)
+{
+  PrintConsole console = defaultConsole;
+  console.frameBuffer  = (u16*)buffer;
+  console.format       = format;
+  return console;
+}
+
+static const char*
+format_name(GSPGPU_FramebufferFormat format)
+{
+  switch(format)
+  {
+    case GSP_RGBA8_OES: return "RGBA8";
+    case GSP_BGR8_OES:  return "BGR8";
+    default:            return "RGB565";
+  }
+}
+
+/** @brief Compare one cell with the reference, widening it for 24/32 bpp */
+static bool
+cell_matches(GSPGPU_FramebufferFormat format, int x, int y)
+{
+  unsigned bpp = gspGetBytesPerPixel(format);
+
+  for(int col = x * 8; col < x * 8 + 8; col++)
+  {
+    for(int row = 232 - y * 8; row < 240 - y * 8; row++)
+    {
+      u16 c      = reference[col * 240 + row];
+      const u8 *pixel = framebuffer + (col * 240 + row) * bpp;
+      u8 r = (c >> 11) << 3, g = ((c >> 5) & 0x3f) << 2, b = (c & 0x1f) << 3;
+
+      r |= r >> 5;
+      g |= g >> 6;
+      b |= b >> 5;
+
+      switch(format)
+      {
+        case GSP_RGBA8_OES:
+          if(pixel[0] != 0xff || pixel[1] != b || pixel[2] != g || pixel[3] != r)
+            return false;
+          break;
+        case GSP_BGR8_OES:
+          if(pixel[0] != b || pixel[1] != g || pixel[2] != r)
+            return false;
+          break;
+        default:
+          if(memcmp(pixel, &c, 2) != 0)
+            return false;
+          break;
+      }
+    }
+  }
+
+  return true;
+}
+
+/** @brief Draw every glyph in every color pair and flag combination */
+static void
+check_format(GSPGPU_FramebufferFormat format)
+{
+  static const int flag_sets[] =
+  {
+    0, CONSOLE_UNDERLINE, CONSOLE_CROSSED_OUT, CONSOLE_UNDERLINE | CONSOLE_CROSSED_OUT,
+  };
+  PrintConsole previous = make_console(GSP_RGB565_OES, reference);
+  PrintConsole console  = make_console(format, framebuffer);
+  int          palette  = sizeof(colorTable) / sizeof(colorTable[0]);
+  unsigned long cells   = 0, bad = 0;
+
+  // every palette pair, then arbitrary 16-bit colors as set by escape codes
+  for(int pair = 0; pair < palette * palette + 256; pair++)
+  {
+    u16 fg, bg;
+    if(pair < palette * palette)
+    {
+      fg = colorTable[pair % palette];
+      bg = colorTable[pair / palette];
+    }
+    else
+    {
+      fg = rnd();
+      bg = rnd();
+    }
+
+    for(size_t f = 0; f < sizeof(flag_sets) / sizeof(flag_sets[0]); f++)
+    {
+      for(int glyph = 0; glyph < defaultConsole.font.numChars; glyph++, cells++)
+      {
+        int x = cells % SCREEN_COLUMNS;
+        int y = (cells / SCREEN_COLUMNS) % SCREEN_ROWS;
+
+        previousRenderChar(&previous, x, y, glyph, fg, bg, flag_sets[f]);
+        consoleRenderChar(&console, x, y, glyph, fg, bg, flag_sets[f]);
+
+        if(!cell_matches(format, x, y) && bad++ < 8)
+          FAIL("%s: glyph %d fg %04x bg %04x flags %x differs", format_name(format),
+               glyph, fg, bg, flag_sets[f]);
+      }
+    }
+  }
+
+  printf("check %-6s %lu cells, %lu mismatches\n", format_name(format), cells, bad);
+}
+
+/** @brief Time drawing characters over the whole screen
+ *  @param[in] format      Framebuffer format, or -1 for the previous renderer
+ *  @param[in] color_every Change colors every this many characters, 0 never
+ *  @returns Seconds taken
+ */
+static double
+bench_run(int format, int color_every)
+{
+  PrintConsole console = make_console(format < 0 ? GSP_RGB565_OES : (GSPGPU_FramebufferFormat)format,
+                                      format < 0 ? (void*)reference : (void*)framebuffer);
+  long   n     = 0;
+  double start = now();
+
+  while(n < BENCH_CHARS)
+  {
+    for(int y = 0; y < SCREEN_ROWS; y++)
+    {
+      for(int x = 0; x < 40; x++, n++)
+      {
+        u16 fg = colorTable[color_every ? 1 + (n / color_every) % 7 : 7];
+
+        if(format < 0)
+          previousRenderChar(&console, x, y, 32 + n % 95, fg, colorTable[0], 0);
+        else
+          consoleRenderChar(&console, x, y, 32 + n % 95, fg, colorTable[0], 0);
+      }
+    }
+  }
+
+  return now() - start;
+}
+
+static void
+bench(void)
+{
+  static const struct
+  {
+    const char *name;
+    int        format;
+    int        color_every;
+  } runs[] =
+  {
+    { "previous RGB565",          -1,             0 },
+    { "RGB565",                   GSP_RGB565_OES, 0 },
+    { "RGB565, color every 4",    GSP_RGB565_OES, 4 },
+    { "previous, color every 4",  -1,             4 },
+    { "BGR8",                     GSP_BGR8_OES,   0 },
+    { "RGBA8",                    GSP_RGBA8_OES,  0 },
+  };
+  const size_t count = sizeof(runs) / sizeof(runs[0]);
+  double       best[sizeof(runs) / sizeof(runs[0])];
+
+  for(size_t i = 0; i < count; i++)
+    best[i] = 1e9;
+
+  // interleave the renderers so that clock changes hit them alike
+  for(int rep = 0; rep < BENCH_RUNS; rep++)
+  {
+    for(size_t i = 0; i < count; i++)
+    {
+      double t = bench_run(runs[i].format, runs[i].color_every);
+      if(t < best[i])
+        best[i] = t;
+    }
+  }
+
+  long chars = (BENCH_CHARS + 1199) / 1200 * 1200;
+  printf("%-24s %10s %8s\n", "renderer", "Mchars/s", "ns/char");
+  for(size_t i = 0; i < count; i++)
+    printf("%-24s %10.2f %8.1f\n", runs[i].name, chars / best[i] / 1e6,
+           best[i] / chars * 1e9);
+}
+
+static void
+usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [--font FILE] [--check] [--bench]\n"
+          "  --font F  font to draw (default ../../data/default_font.bin)\n"
+          "  --check   compare every format with the previous renderer (default)\n"
+          "  --bench   report characters per second per renderer and format\n",
+          argv0);
+  exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *font  = "../../data/default_font.bin";
+  bool       check = false, run_bench = false;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "--check") == 0)
+      check = true;
+    else if(strcmp(argv[i], "--bench") == 0)
+      run_bench = true;
+    else if(strcmp(argv[i], "--font") == 0 && i + 1 < argc)
+      font = argv[++i];
+    else
+      usage(argv[0]);
+  }
+
+  if(!check && !run_bench)
+    check = true;
+
+  FILE *fp = fopen(font, "rb");
+  if(!fp || fread(default_font_bin, 1, sizeof(default_font_bin), fp) != sizeof(default_font_bin))
+  {
+    fprintf(stderr, "%s: can't read %s\n", argv[0], font);
+    return EXIT_FAILURE;
+  }
+  fclose(fp);
+
+  if(check)
+  {
+    check_format(GSP_RGB565_OES);
+    check_format(GSP_BGR8_OES);
+    check_format(GSP_RGBA8_OES);
+  }
+
+  if(run_bench)
+    bench();
+
+  if(failures)
+  {
+    fprintf(stderr, "%d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,6 @@
+/** @file default_font_bin.h
+ *  @brief Host stand-in for the generated header; the test loads the font
+ */
+#pragma once
+
+extern unsigned char default_font_bin[];
@@ -0,0 +1,25 @@
+/** @file iosupport.h
+ *  @brief Host stand-in for the devkitARM header, with what console.c uses
+ */
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+struct _reent;
+
+typedef struct
+{
+  const char *name;
+  size_t     structSize;
+  int        (*open_r)(struct _reent *r, void *fileStruct, const char *path, int flags, int mode);
+  int        (*close_r)(struct _reent *r, void *fd);
+  ssize_t    (*write_r)(struct _reent *r, void *fd, const char *ptr, size_t len);
+  ssize_t    (*read_r)(struct _reent *r, void *fd, char *ptr, size_t len);
+  off_t      (*seek_r)(struct _reent *r, void *fd, off_t pos, int dir);
+  int        (*fstat_r)(struct _reent *r, void *fd, void *st);
+} devoptab_t;
+
+enum { STD_IN, STD_OUT, STD_ERR };
+
+extern const devoptab_t *devoptab_list[];
@@ -0,0 +1,816 @@
+/** @file decompress_test.c
+ *  @brief Host test, benchmark and fuzzer for the decompression routines
+ *
+ *  Every decompressType is run over synthetic streams and over data shaped
+ *  like what games ship (text, images, tiles), through the memory, FD, Stdio,
+ *  chunked callback, multi-buffer and streaming paths. Fuzzing feeds the
+ *  same paths truncated and corrupted streams; build with the sanitizers
+ *  (make check) so that memory errors and undefined behaviour stop the run.
+ */
+#include <3ds/util/compress.h>
+#include <3ds/util/decompress.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CHECK_SIZE  0x10000  ///< Uncompressed size for round-trip checks
+#define BENCH_SIZE  0x400000 ///< Uncompressed size for benchmarks
+#define FUZZ_SIZE   0x2000   ///< Max uncompressed size for fuzzing
+
+static int failures;
+
+#define FAIL(...) \
+  do { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); ++failures; } while(0)
+
+/** @brief Input data shapes */
+typedef enum
+{
+  SHAPE_TEXT,   ///< Words and line breaks
+  SHAPE_IMAGE,  ///< RGBA gradient with noise in the low bits
+  SHAPE_TILES,  ///< 8x8 tiles drawn from a small set
+  SHAPE_ZEROS,  ///< All zeros
+  SHAPE_RANDOM, ///< Incompressible
+  SHAPE_COUNT,
+} shape_t;
+
+static const char *shape_names[SHAPE_COUNT] =
+{
+  "text", "image", "tiles", "zeros", "random",
+};
+
+/** @brief Compressed test case */
+typedef struct
+{
+  decompressType type;   ///< Decompression type
+  compressLevel  level;  ///< Compression level
+  const char     *name;  ///< Description
+  uint8_t        *plain; ///< Uncompressed data
+  size_t         size;   ///< Uncompressed size
+  uint8_t        *comp;  ///< Compressed data
+  size_t         csize;  ///< Compressed size
+} test_case;
+
+/** @brief Counting callback source */
+typedef struct
+{
+  int           fd;      ///< File descriptor (FD source)
+  FILE          *fp;     ///< Stream (Stdio source)
+  const uint8_t *data;   ///< Data (chunked source)
+  size_t        size;    ///< Data size (chunked source)
+  size_t        pos;     ///< Data position (chunked source)
+  size_t        chunk;   ///< Max bytes per call (chunked source)
+  unsigned long calls;   ///< Number of callback invocations
+} source_t;
+
+static ssize_t
+fd_source(void *userdata, void *buffer, size_t size)
+{
+  source_t *src = (source_t*)userdata;
+  ++src->calls;
+  return decompressCallback_FD(&src->fd, buffer, size);
+}
+
+static ssize_t
+stdio_source(void *userdata, void *buffer, size_t size)
+{
+  source_t *src = (source_t*)userdata;
+  ++src->calls;
+  return decompressCallback_Stdio(src->fp, buffer, size);
+}
+
+static ssize_t
+chunked_source(void *userdata, void *buffer, size_t size)
+{
+  source_t *src  = (source_t*)userdata;
+  size_t   avail = src->size - src->pos;
+
+  ++src->calls;
+  if(size > avail)
+    size = avail;
+  if(size > src->chunk)
+    size = src->chunk;
+
+  memcpy(buffer, src->data + src->pos, size);
+  src->pos += size;
+  return size;
+}
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t
+rnd(size_t n)
+{
+  return n ? (size_t)rand() % n : 0;
+}
+
+static void
+fill_shape(uint8_t *data, size_t size, shape_t shape)
+{
+  static const char *words[] =
+  {
+    "the ", "of ", "shader ", "texture ", "save ", "data ", "player ",
+    "level ", "menu ", "sound ", "a ", "to ", "and ", "\n", ", ",
+  };
+
+  switch(shape)
+  {
+    case SHAPE_TEXT:
+      for(size_t pos = 0; pos < size; )
+      {
+        const char *word = words[rnd(sizeof(words) / sizeof(words[0]))];
+        for(; *word && pos < size; ++word)
+          data[pos++] = *word;
+      }
+      break;
+
+    case SHAPE_IMAGE:
+      for(size_t i = 0; i < size; ++i)
+      {
+        size_t pixel = i / 4, x = pixel % 256, y = pixel / 256;
+        switch(i % 4)
+        {
+          case 0: data[i] = x ^ rnd(4);       break;
+          case 1: data[i] = y ^ rnd(4);       break;
+          case 2: data[i] = (x + y) ^ rnd(2); break;
+          default: data[i] = 0xFF;            break;
+        }
+      }
+      break;
+
+    case SHAPE_TILES:
+    {
+      uint8_t tiles[8][64];
+      for(size_t i = 0; i < sizeof(tiles); ++i)
+        tiles[i / 64][i % 64] = rnd(16);
+      for(size_t pos = 0; pos < size; pos += 64)
+      {
+        size_t len = size - pos < 64 ? size - pos : 64;
+        memcpy(data + pos, tiles[rnd(8)], len);
+      }
+      break;
+    }
+
+    case SHAPE_ZEROS:
+      memset(data, 0, size);
+      break;
+
+    default:
+      for(size_t i = 0; i < size; ++i)
+        data[i] = rand();
+      break;
+  }
+}
+
+/** @brief Compress data with the library compressors
+ *  @returns Compressed size
+ *  @retval -1 error
+ */
+static ssize_t
+compress_any(decompressType type, compressLevel level, uint8_t *out,
+             size_t outsize, const uint8_t *in, size_t size)
+{
+  switch(type)
+  {
+    case DECOMPRESS_DUMMY:
+      if(outsize < size + 4)
+        return -1;
+      out[0] = DECOMPRESS_DUMMY;
+      out[1] = size;
+      out[2] = size >> 8;
+      out[3] = size >> 16;
+      memcpy(out + 4, in, size);
+      return size + 4;
+
+    case DECOMPRESS_LZSS:
+      return compressLZSS(out, outsize, in, size, level);
+
+    case DECOMPRESS_LZ11:
+      return compressLZ11(out, outsize, in, size, level);
+
+    case DECOMPRESS_RLE:
+      return compressRLE(out, outsize, in, size);
+
+    default:
+      return compressHuff(type & 0xF, out, outsize, in, size);
+  }
+}
+
+/** @brief Build a test case from data of the given shape */
+static void
+make_case(test_case *tc, decompressType type, compressLevel level,
+          shape_t shape, size_t size)
+{
+  static char names[64][64];
+  static size_t next;
+
+  tc->type  = type;
+  tc->level = level;
+  tc->size  = size;
+  tc->plain = (uint8_t*)malloc(size ? size : 1);
+  fill_shape(tc->plain, size, shape);
+
+  // every Huffman symbol must fit in the data size
+  if((type & 0xF0) == 0x20)
+  {
+    for(size_t i = 0; i < size; ++i)
+      tc->plain[i] &= (1 << (type & 0xF)) - 1;
+  }
+
+  size_t limit = compressMaxSize(type, size);
+  if(limit < size + 4)
+    limit = size + 4;
+  tc->comp  = (uint8_t*)malloc(limit);
+  ssize_t csize = compress_any(type, level, tc->comp, limit, tc->plain, size);
+  if(csize < 0)
+  {
+    FAIL("compress type 0x%02x %s failed", type, shape_names[shape]);
+    csize = 0;
+  }
+  tc->csize = csize;
+
+  char *name = names[next++ % 64];
+  snprintf(name, 64, "0x%02x %-4s %-6s", type,
+           (type == DECOMPRESS_LZSS || type == DECOMPRESS_LZ11)
+             ? (level == COMPRESS_BEST ? "best" : "fast") : "",
+           shape_names[shape]);
+  tc->name = name;
+}
+
+static void
+free_case(test_case *tc)
+{
+  free(tc->plain);
+  free(tc->comp);
+}
+
+/** @brief Write data to an unlinked temporary file */
+static FILE*
+temp_file(const uint8_t *data, size_t size)
+{
+  FILE *fp = tmpfile();
+  if(!fp)
+  {
+    perror("tmpfile");
+    exit(EXIT_FAILURE);
+  }
+
+  if(fwrite(data, 1, size, fp) != size)
+  {
+    perror("fwrite");
+    exit(EXIT_FAILURE);
+  }
+
+  fflush(fp);
+  return fp;
+}
+
+/** @brief Decode through the streaming API with small windows
+ *  @returns Whether all output was produced
+ */
+static bool
+decode_stream(const uint8_t *in, size_t insize, uint8_t *out, size_t outsize,
+              size_t inchunk, size_t outchunk)
+{
+  decompressStream *stream = decompressStreamCreate();
+  size_t           inpos = 0, outpos = 0;
+  bool             done = false;
+
+  if(!stream)
+    return false;
+
+  for(;;)
+  {
+    size_t inlen  = insize - inpos < inchunk ? insize - inpos : inchunk;
+    size_t outlen = outsize - outpos < outchunk ? outsize - outpos : outchunk;
+    size_t inused = 0, outused = 0;
+
+    decompressStreamStatus status = decompressStreamRun(stream, in + inpos,
+                                                        inlen, &inused,
+                                                        out + outpos, outlen,
+                                                        &outused);
+    inpos  += inused;
+    outpos += outused;
+
+    if(status == DECOMPRESS_STREAM_DONE)
+    {
+      done = true;
+      break;
+    }
+
+    // stop when no progress can be made
+    if(status == DECOMPRESS_STREAM_ERROR || (!inused && !outused))
+      break;
+  }
+
+  decompressStreamFree(stream);
+  return done;
+}
+
+/** @brief Check that a test case decodes correctly through every source */
+static void
+check_case(const test_case *tc)
+{
+  uint8_t *out = (uint8_t*)malloc(tc->size + 1);
+  size_t  size = tc->size;
+
+#define VERIFY(ok, path) \
+  do { \
+    if(!(ok) || memcmp(out, tc->plain, size) != 0) \
+      FAIL("%s: %s decode failed", tc->name, path); \
+    memset(out, 0xA5, size); \
+  } while(0)
+
+  memset(out, 0xA5, size);
+
+  VERIFY(decompress(out, size, NULL, tc->comp, tc->csize), "memory");
+
+  FILE *fp = temp_file(tc->comp, tc->csize);
+  source_t src = { .fd = fileno(fp), .fp = fp };
+  lseek(src.fd, 0, SEEK_SET);
+  VERIFY(decompress(out, size, fd_source, &src, 0), "FD");
+
+  rewind(fp);
+  VERIFY(decompress(out, size, stdio_source, &src, 0), "Stdio");
+  fclose(fp);
+
+  for(size_t chunk = 1; chunk <= 4096; chunk *= 8)
+  {
+    source_t chunked = { .data = tc->comp, .size = tc->csize, .chunk = chunk };
+    VERIFY(decompress(out, size, chunked_source, &chunked, 0), "chunked");
+  }
+
+  size_t a = size / 3, b = size / 5;
+  decompressIOVec iov[3] =
+  {
+    { out, a }, { out + a, b }, { out + a + b, size - a - b },
+  };
+  VERIFY(decompressV(iov, 3, NULL, tc->comp, tc->csize), "multi-buffer");
+
+  if(tc->type == DECOMPRESS_LZSS)
+    VERIFY(decompress_LZSS_mem(out, size, tc->comp + 4, tc->csize - 4), "LZSS_mem");
+  else if(tc->type == DECOMPRESS_LZ11)
+    VERIFY(decompress_LZ11_mem(out, size, tc->comp + 4, tc->csize - 4), "LZ11_mem");
+
+  VERIFY(decode_stream(tc->comp, tc->csize, out, size, 7, 33), "stream");
+  VERIFY(decode_stream(tc->comp, tc->csize, out, size, 4096, 4096), "stream");
+
+#undef VERIFY
+
+  free(out);
+}
+
+/** @brief Append a random but well-formed LZ10/LZ11 stream
+ *
+ *  Unlike the compressors, this uses every match length class and
+ *  distances right up to the start of the output.
+ */
+static size_t
+synth_lz(uint8_t *in, decompressType type, size_t size)
+{
+  size_t pos = 4, written = 0;
+
+  while(written < size)
+  {
+    size_t  flagpos = pos++;
+    uint8_t flags   = 0;
+
+    for(int i = 0; i < 8 && written < size; ++i)
+    {
+      if(written == 0 || rnd(2))
+      {
+        in[pos++] = rnd(3) ? rand() : 'a';
+        ++written;
+        continue;
+      }
+
+      flags |= 0x80 >> i;
+
+      size_t disp = 1 + rnd(written < 4096 ? written : 4096);
+      if(rnd(4) == 0)
+        disp = 1 + rnd(written < 4 ? written : 4);
+
+      size_t len;
+      if(type == DECOMPRESS_LZSS)
+      {
+        len = 3 + rnd(16);
+        in[pos++] = ((len - 3) << 4) | ((disp - 1) >> 8);
+      }
+      else if(rnd(3) == 0)
+      {
+        len = 3 + rnd(14);
+        in[pos++] = ((len - 1) << 4) | ((disp - 1) >> 8);
+      }
+      else if(rnd(2))
+      {
+        len = 0x11 + rnd(256);
+        in[pos++] = (len - 0x11) >> 4;
+        in[pos++] = (((len - 0x11) & 0xF) << 4) | ((disp - 1) >> 8);
+      }
+      else
+      {
+        len = 0x111 + rnd(2000);
+        in[pos++] = 0x10 | ((len - 0x111) >> 12);
+        in[pos++] = (len - 0x111) >> 4;
+        in[pos++] = (((len - 0x111) & 0xF) << 4) | ((disp - 1) >> 8);
+      }
+      in[pos++] = disp - 1;
+
+      written += len;
+    }
+
+    in[flagpos] = flags;
+  }
+
+  // the last match may overshoot; the header records what was produced
+  in[0] = type;
+  in[1] = written;
+  in[2] = written >> 8;
+  in[3] = written >> 16;
+  return pos;
+}
+
+/** @brief Random Huffman tree node */
+typedef struct
+{
+  bool leaf;
+  int  value, left, right;
+} synth_node;
+
+static synth_node synth_nodes[1024];
+static int        synth_count;
+
+static int
+synth_tree(int leaves, int bits)
+{
+  int node = synth_count++;
+
+  if(leaves == 1)
+  {
+    synth_nodes[node].leaf  = true;
+    synth_nodes[node].value = rnd(1 << bits);
+    return node;
+  }
+
+  int left = rnd(3) == 0 ? 1 : 1 + rnd(leaves - 1);
+  synth_nodes[node].leaf  = false;
+  synth_nodes[node].left  = synth_tree(left, bits);
+  synth_nodes[node].right = synth_tree(leaves - left, bits);
+  return node;
+}
+
+/** @brief Lay out a random Huffman tree in the stream format
+ *  @returns Tree size in bytes, or 0 if the offsets don't fit
+ */
+static size_t
+synth_layout(uint8_t *tree, int leaves, int bits)
+{
+  int queue[1024], parent[1024], head = 0, tail = 0, next = 2;
+
+  synth_count = 0;
+  int root = synth_tree(leaves, bits);
+  if(synth_nodes[root].leaf)
+    return 0;
+
+  memset(tree, 0, 512);
+  tree[0] = leaves - 1;
+  queue[tail] = root;
+  parent[tail++] = 1;
+
+  while(head < tail)
+  {
+    int node = queue[head], at = parent[head++];
+    int pair = next, offset = (pair - (at & ~1) - 2) / 2;
+    next += 2;
+    if(offset < 0 || offset > 63)
+      return 0;
+
+    uint8_t    info  = offset;
+    synth_node *left = &synth_nodes[synth_nodes[node].left];
+    synth_node *right = &synth_nodes[synth_nodes[node].right];
+
+    if(left->leaf)
+    {
+      info |= 0x80;
+      tree[pair] = left->value;
+    }
+    else
+    {
+      queue[tail] = synth_nodes[node].left;
+      parent[tail++] = pair;
+    }
+
+    if(right->leaf)
+    {
+      info |= 0x40;
+      tree[pair + 1] = right->value;
+    }
+    else
+    {
+      queue[tail] = synth_nodes[node].right;
+      parent[tail++] = pair + 1;
+    }
+
+    tree[at] = info;
+  }
+
+  return leaves * 2;
+}
+
+/** @brief Append a random Huffman stream with an arbitrary tree shape */
+static size_t
+synth_huff(uint8_t *in, int bits, size_t size)
+{
+  int    maxleaves = bits >= 8 ? 256 : 1 << bits;
+  size_t treesize;
+
+  do
+    treesize = synth_layout(in + 4, 2 + rnd(maxleaves - 1), bits);
+  while(!treesize);
+
+  in[0] = 0x20 | bits;
+  in[1] = size;
+  in[2] = size >> 8;
+  in[3] = size >> 16;
+
+  // random bits always decode to something, so just provide enough of them
+  size_t pos = 4 + treesize, words = (size * 8 / 4 + 64) / 4;
+  for(size_t i = 0; i < words * 4; ++i)
+    in[pos++] = rand();
+  return pos;
+}
+
+/** @brief Decode through every path, which must not crash or overrun
+ *  @returns Whether the memory path succeeded
+ */
+static bool
+fuzz_decode(uint8_t *in, size_t insize, uint8_t *out, size_t size)
+{
+  bool ok = decompress(out, size, NULL, in, insize);
+
+  source_t chunked = { .data = in, .size = insize, .chunk = 1 + rnd(64) };
+  decompress(out, size, chunked_source, &chunked, 0);
+
+  size_t a = size / 3, b = size / 3;
+  decompressIOVec iov[3] =
+  {
+    { out, a }, { out + a, b }, { out + a + b, size - a - b },
+  };
+  decompressV(iov, 3, NULL, in, insize);
+
+  if(insize >= 4)
+  {
+    decompress_LZSS_mem(out, size, in + 4, insize - 4);
+    decompress_LZ11_mem(out, size, in + 4, insize - 4);
+  }
+
+  decode_stream(in, insize, out, size, 1 + rnd(64), 1 + rnd(256));
+  return ok;
+}
+
+static void
+fuzz(unsigned long iterations)
+{
+  static uint8_t in[0x40000], plain[FUZZ_SIZE], out[FUZZ_SIZE + 0x10000];
+  static const decompressType types[] =
+  {
+    DECOMPRESS_DUMMY, DECOMPRESS_LZSS, DECOMPRESS_LZ11, DECOMPRESS_HUFF1,
+    DECOMPRESS_HUFF2, DECOMPRESS_HUFF3, DECOMPRESS_HUFF4, DECOMPRESS_HUFF5,
+    DECOMPRESS_HUFF6, DECOMPRESS_HUFF7, DECOMPRESS_HUFF8, DECOMPRESS_RLE,
+  };
+  unsigned long decoded = 0;
+
+  for(unsigned long it = 0; it < iterations; ++it)
+  {
+    decompressType type = types[rnd(sizeof(types) / sizeof(types[0]))];
+    size_t         size = rnd(FUZZ_SIZE);
+    size_t         insize;
+    bool           reference = false;
+
+    // half of the streams come from the compressors, so their output can be checked
+    if(rnd(2) || type == DECOMPRESS_DUMMY || type == DECOMPRESS_RLE)
+    {
+      fill_shape(plain, size, (shape_t)rnd(SHAPE_COUNT));
+      if((type & 0xF0) == 0x20)
+      {
+        for(size_t i = 0; i < size; ++i)
+          plain[i] &= (1 << (type & 0xF)) - 1;
+      }
+
+      ssize_t csize = compress_any(type, (compressLevel)rnd(2), in, sizeof(in),
+                                   plain, size);
+      if(csize < 0)
+      {
+        FAIL("fuzz: compress type 0x%02x size %zu failed", type, size);
+        continue;
+      }
+      insize    = csize;
+      reference = true;
+    }
+    else if(type == DECOMPRESS_LZSS || type == DECOMPRESS_LZ11)
+    {
+      insize = synth_lz(in, type, size);
+      size   = in[1] | (in[2] << 8) | ((size_t)in[3] << 16);
+    }
+    else
+      insize = synth_huff(in, type & 0xF, size);
+
+    if(!fuzz_decode(in, insize, out, size))
+      FAIL("fuzz: valid stream type 0x%02x size %zu failed", type, size);
+    else if(reference && memcmp(out, plain, size) != 0)
+      FAIL("fuzz: valid stream type 0x%02x size %zu decoded wrong", type, size);
+
+    switch(rnd(4))
+    {
+      case 0:
+        // truncate the input
+        insize = rnd(insize + 1);
+        break;
+
+      case 1:
+        // flip bits past the header
+        for(int i = 1 + rnd(4); i > 0 && insize > 4; --i)
+          in[4 + rnd(insize - 4)] ^= 1 << rnd(8);
+        break;
+
+      case 2:
+        // corrupt the header, including the extended size form
+        in[0] = rnd(2) ? (uint8_t)rand() : (uint8_t)(type | 0x80);
+        for(size_t i = 1; i < 8 && i < insize; ++i)
+          in[i] = rand();
+        break;
+
+      default:
+        // claim more output than the stream holds
+        size = size + rnd(sizeof(out) - size);
+        break;
+    }
+
+    decoded += fuzz_decode(in, insize, out, size);
+  }
+
+  printf("fuzz: %lu iterations, %lu corrupted streams still decoded\n",
+         iterations, decoded);
+}
+
+static void
+bench_case(const test_case *tc)
+{
+  uint8_t *out = (uint8_t*)malloc(tc->size);
+  double  mb   = tc->size / 1e6;
+  int     reps = 4;
+  double  start, comp, mem, fdt, stdt, strt;
+
+  size_t  limit   = compressMaxSize(tc->type, tc->size);
+  if(limit < tc->size + 4)
+    limit = tc->size + 4;
+  uint8_t *packed = (uint8_t*)malloc(limit);
+
+  start = now();
+  for(int i = 0; i < reps; ++i)
+    compress_any(tc->type, tc->level, packed, limit, tc->plain, tc->size);
+  comp = (now() - start) / reps;
+  free(packed);
+
+  // fault in the output pages before timing anything
+  decompress(out, tc->size, NULL, tc->comp, tc->csize);
+
+  start = now();
+  for(int i = 0; i < reps; ++i)
+    decompress(out, tc->size, NULL, tc->comp, tc->csize);
+  mem = (now() - start) / reps;
+
+  FILE *fp = temp_file(tc->comp, tc->csize);
+  source_t fdsrc = { .fd = fileno(fp) }, stdsrc = { .fp = fp };
+
+  start = now();
+  for(int i = 0; i < reps; ++i)
+  {
+    lseek(fdsrc.fd, 0, SEEK_SET);
+    decompress(out, tc->size, fd_source, &fdsrc, 0);
+  }
+  fdt = (now() - start) / reps;
+
+  start = now();
+  for(int i = 0; i < reps; ++i)
+  {
+    rewind(fp);
+    decompress(out, tc->size, stdio_source, &stdsrc, 0);
+  }
+  stdt = (now() - start) / reps;
+  fclose(fp);
+
+  start = now();
+  for(int i = 0; i < reps; ++i)
+    decode_stream(tc->comp, tc->csize, out, tc->size, 0x1000, 0x1000);
+  strt = (now() - start) / reps;
+
+  printf("%-20s %6.1f%% %9.1f %9.1f %9.1f %9.1f %9.1f %8lu %8lu\n", tc->name,
+         tc->size ? 100.0 * tc->csize / tc->size : 0.0, mb / comp,
+         mb / mem, mb / fdt, mb / stdt, mb / strt,
+         fdsrc.calls / reps, stdsrc.calls / reps);
+
+  free(out);
+}
+
+/** @brief Run fn over every type, level and shape */
+static void
+for_each_case(size_t size, void (*fn)(const test_case*))
+{
+  static const decompressType types[] =
+  {
+    DECOMPRESS_DUMMY, DECOMPRESS_LZSS, DECOMPRESS_LZ11, DECOMPRESS_HUFF1,
+    DECOMPRESS_HUFF2, DECOMPRESS_HUFF4, DECOMPRESS_HUFF8, DECOMPRESS_RLE,
+  };
+
+  for(size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t)
+  {
+    decompressType type   = types[t];
+    int            levels = (type == DECOMPRESS_LZSS || type == DECOMPRESS_LZ11) ? 2 : 1;
+
+    for(int level = 0; level < levels; ++level)
+    {
+      for(int shape = 0; shape < SHAPE_COUNT; ++shape)
+      {
+        test_case tc;
+        make_case(&tc, type, (compressLevel)level, (shape_t)shape, size);
+        fn(&tc);
+        free_case(&tc);
+      }
+    }
+  }
+}
+
+static void
+usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [--check] [--fuzz N] [--bench] [--seed N]\n"
+          "  --check   round-trip every type through every source (default)\n"
+          "  --fuzz N  decode N random, truncated and corrupted streams\n"
+          "  --bench   report compression MB/s, and MB/s and callback counts\n"
+          "            per decompression source\n",
+          argv0);
+  exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char *argv[])
+{
+  bool          check = false, bench = false;
+  unsigned long iterations = 0;
+  unsigned      seed = 1;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "--check") == 0)
+      check = true;
+    else if(strcmp(argv[i], "--bench") == 0)
+      bench = true;
+    else if(strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc)
+      iterations = strtoul(argv[++i], NULL, 0);
+    else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+      seed = strtoul(argv[++i], NULL, 0);
+    else
+      usage(argv[0]);
+  }
+
+  if(!check && !bench && !iterations)
+    check = true;
+
+  srand(seed);
+
+  if(check)
+  {
+    for_each_case(CHECK_SIZE, check_case);
+    for(size_t size = 0; size < 64; ++size)
+      for_each_case(size, check_case);
+    printf("check: done\n");
+  }
+
+  if(iterations)
+    fuzz(iterations);
+
+  if(bench)
+  {
+    printf("%-20s %7s %9s %9s %9s %9s %9s %8s %8s\n", "case", "ratio",
+           "comp MB/s", "mem MB/s", "FD MB/s", "stdio", "stream", "FD calls", "stdio");
+    for_each_case(BENCH_SIZE, bench_case);
+  }
+
+  if(failures)
+  {
+    fprintf(stderr, "%d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,341 @@
+/** @file convert_test.c
+ *  @brief Host test and benchmark for the float16/float24 conversions
+ *
+ *  The bulk conversions in source/gpu/gpu.c must give the same bits as the
+ *  scalar conversions they replace, which are kept here as the reference.
+ *  The default check covers every sign and exponent with the mantissa bits
+ *  around each rounding boundary plus random inputs; --exhaustive runs all
+ *  2^32 inputs. Packed vectors are compared with the byte shuffle that
+ *  shaderInstanceInit() applies to DVLE float24 constants.
+ */
+#include <3ds/types.h>
+#include <3ds/allocator/linear.h>
+#include <3ds/gpu/gpu.h>
+#include <3ds/os.h>
+#include <3ds/services/gspgpu.h>
+#include <3ds/svc.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BLOCK       4096   ///< Elements converted per call
+#define BENCH_REPS  20000  ///< Blocks converted per benchmark run
+
+static int failures;
+
+#define FAIL(...) \
+  do { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); ++failures; } while(0)
+
+// gpu.c links against the rest of libctru, none of which the conversions use
+void svcBreak(UserBreakType breakReason) { abort(); }
+void* linearAlloc(size_t size) { return calloc(1, size); }
+void linearFree(void* mem) { free(mem); }
+u32 osConvertVirtToPhys(const void* vaddr) { return 0; }
+Result GSPGPU_FlushDataCache(const void* adr, u32 size) { return 0; }
+
+static inline u32
+floatrawbits(float f)
+{
+  union { float f; u32 i; } s;
+  s.f = f;
+  return s.i;
+}
+
+/** @brief f32tof16 as it was before the bulk conversions, called out of line
+ *  like the library function */
+static __attribute__((noinline)) u32
+reference_f32tof16(float f)
+{
+  u32 i = floatrawbits(f);
+
+  u32 mantissa = (i << 9) >>  9;
+  s32 exponent = (i << 1) >> 24;
+  u32 sign     = (i << 0) >> 31;
+
+  // Truncate mantissa
+  mantissa >>= 13;
+
+  // Re-bias exponent
+  exponent = exponent - 127 + 15;
+  if(exponent < 0)
+    return sign << 15;
+  else if(exponent > 0x1F)
+    return sign << 15 | 0x1F << 10;
+
+  return sign << 15 | exponent << 10 | mantissa;
+}
+
+/** @brief f32tof24 as it was before the bulk conversions, called out of line
+ *  like the library function */
+static __attribute__((noinline)) u32
+reference_f32tof24(float f)
+{
+  u32 i = floatrawbits(f);
+
+  u32 mantissa = (i << 9) >>  9;
+  s32 exponent = (i << 1) >> 24;
+  u32 sign     = (i << 0) >> 31;
+
+  // Truncate mantissa
+  mantissa >>= 7;
+
+  // Re-bias exponent
+  exponent = exponent - 127 + 63;
+  if(exponent < 0)
+    return sign << 23;
+  else if(exponent > 0x7F)
+    return sign << 23 | 0x7F << 16;
+
+  return sign << 23 | exponent << 16 | mantissa;
+}
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static u32
+rnd(void)
+{
+  static u32 state = 1;
+  state = state * 1103515245 + 12345;
+  return (state >> 16) | (state << 16);
+}
+
+/** @brief Convert one block of inputs every way and compare with the reference
+ *  @param[in] bits  Raw bits of the inputs
+ *  @param[in] count Number of inputs, at most BLOCK
+ */
+static void
+check_block(const u32 *bits, u32 count)
+{
+  static float in[BLOCK];
+  static u16   out16[BLOCK];
+  static u32   out24[BLOCK], packed[BLOCK / 4 * 3];
+
+  memcpy(in, bits, count * sizeof(float));
+  f32tof16Array(out16, in, count);
+  f32tof24Array(out24, in, count);
+  f32tof24Vec4Packed(packed, in, count / 4);
+
+  for(u32 i = 0; i < count; ++i)
+  {
+    u32 f16 = reference_f32tof16(in[i]), f24 = reference_f32tof24(in[i]);
+
+    if(out16[i] != f16 || f32tof16(in[i]) != f16)
+      FAIL("f16 of %08x: array %04x scalar %04x, expected %04x", bits[i],
+           out16[i], (unsigned)f32tof16(in[i]), (unsigned)f16);
+    if(out24[i] != f24 || f32tof24(in[i]) != f24)
+      FAIL("f24 of %08x: array %06x scalar %06x, expected %06x", bits[i],
+           (unsigned)out24[i], (unsigned)f32tof24(in[i]), (unsigned)f24);
+    if(failures > 16)
+      exit(EXIT_FAILURE);
+  }
+
+  for(u32 v = 0; v < count / 4; ++v)
+  {
+    // the components are laid out back to back, then sent last word first
+    u32 rev[3];
+    u8  *rev8 = (u8*)rev;
+    for(int c = 0; c < 4; ++c)
+    {
+      u32 f24 = reference_f32tof24(in[v * 4 + c]);
+      memcpy(&rev8[c * 3], &f24, 3);
+    }
+
+    if(packed[v * 3] != rev[2] || packed[v * 3 + 1] != rev[1] || packed[v * 3 + 2] != rev[0])
+      FAIL("packed vector %08x %08x %08x %08x: %08x %08x %08x, expected %08x %08x %08x",
+           bits[v * 4], bits[v * 4 + 1], bits[v * 4 + 2], bits[v * 4 + 3],
+           (unsigned)packed[v * 3], (unsigned)packed[v * 3 + 1], (unsigned)packed[v * 3 + 2],
+           (unsigned)rev[2], (unsigned)rev[1], (unsigned)rev[0]);
+  }
+}
+
+/** @brief Every sign and exponent, with the mantissa around rounding edges */
+static void
+check(void)
+{
+  static const u32 mantissas[] =
+  {
+    0x000000, 0x000001, 0x00003F, 0x000040, 0x000041, 0x00007F, 0x000080,
+    0x000FFF, 0x001000, 0x001001, 0x001FFF, 0x002000, 0x400000, 0x7FFF80,
+    0x7FFFBF, 0x7FE000, 0x7FEFFF, 0x7FFFFF,
+  };
+  static u32 bits[BLOCK];
+  u32        n = 0;
+  unsigned long total = 0;
+
+  for(u32 top = 0; top < 0x200; ++top)
+  {
+    for(size_t m = 0; m < sizeof(mantissas) / sizeof(mantissas[0]); ++m)
+      bits[n++] = top << 23 | mantissas[m];
+    for(int r = 0; r < 64; ++r)
+      bits[n++] = top << 23 | (rnd() & 0x7FFFFF);
+
+    // odd sizes exercise the loop tails
+    if(n > BLOCK - 128)
+    {
+      check_block(bits, n - top % 7);
+      total += n - top % 7;
+      n = 0;
+    }
+  }
+  check_block(bits, n);
+  total += n;
+
+  printf("check: %lu inputs\n", total);
+}
+
+/** @brief All 2^32 inputs */
+static void
+check_exhaustive(void)
+{
+  static u32 bits[BLOCK];
+
+  for(u64 base = 0; base < (1ULL << 32); base += BLOCK)
+  {
+    for(u32 i = 0; i < BLOCK; ++i)
+      bits[i] = base + i;
+    check_block(bits, BLOCK);
+  }
+
+  printf("exhaustive: all 2^32 inputs\n");
+}
+
+static void
+bench(void)
+{
+  static float in[BLOCK];
+  static u16   out16[BLOCK];
+  static u32   out24[BLOCK], packed[BLOCK / 4 * 3];
+  volatile u32 sink = 0;
+  double       start, t[7];
+  double       elements = (double)BLOCK * BENCH_REPS / 1e6;
+
+  for(int i = 0; i < BLOCK; ++i)
+    in[i] = ((float)(rnd() & 0xFFFFFF) / 0x1000000 - 0.5f) * 1000.0f;
+
+  start = now();
+  for(int r = 0; r < BENCH_REPS; ++r)
+  {
+    for(int i = 0; i < BLOCK; ++i)
+      out16[i] = reference_f32tof16(in[i]);
+    sink += out16[r % BLOCK];
+  }
+  t[0] = now() - start;
+
+  start = now();
+  for(int r = 0; r < BENCH_REPS; ++r)
+  {
+    for(int i = 0; i < BLOCK; ++i)
+      out16[i] = f32tof16(in[i]);
+    sink += out16[r % BLOCK];
+  }
+  t[1] = now() - start;
+
+  start = now();
+  for(int r = 0; r < BENCH_REPS; ++r)
+  {
+    f32tof16Array(out16, in, BLOCK);
+    sink += out16[r % BLOCK];
+  }
+  t[2] = now() - start;
+
+  start = now();
+  for(int r = 0; r < BENCH_REPS; ++r)
+  {
+    for(int i = 0; i < BLOCK; ++i)
+      out24[i] = reference_f32tof24(in[i]);
+    sink += out24[r % BLOCK];
+  }
+  t[3] = now() - start;
+
+  start = now();
+  for(int r = 0; r < BENCH_REPS; ++r)
+  {
+    for(int i = 0; i < BLOCK; ++i)
+      out24[i] = f32tof24(in[i]);
+    sink += out24[r % BLOCK];
+  }
+  t[4] = now() - start;
+
+  start = now();
+  for(int r = 0; r < BENCH_REPS; ++r)
+  {
+    f32tof24Array(out24, in, BLOCK);
+    sink += out24[r % BLOCK];
+  }
+  t[5] = now() - start;
+
+  start = now();
+  for(int r = 0; r < BENCH_REPS; ++r)
+  {
+    f32tof24Vec4Packed(packed, in, BLOCK / 4);
+    sink += packed[r % (BLOCK / 4 * 3)];
+  }
+  t[6] = now() - start;
+
+  printf("%-28s %12s\n", "conversion", "M elements/s");
+  printf("%-28s %12.1f\n", "f16 reference loop", elements / t[0]);
+  printf("%-28s %12.1f\n", "f16 f32tof16 loop", elements / t[1]);
+  printf("%-28s %12.1f\n", "f16 f32tof16Array", elements / t[2]);
+  printf("%-28s %12.1f\n", "f24 reference loop", elements / t[3]);
+  printf("%-28s %12.1f\n", "f24 f32tof24 loop", elements / t[4]);
+  printf("%-28s %12.1f\n", "f24 f32tof24Array", elements / t[5]);
+  printf("%-28s %12.1f\n", "f24 f32tof24Vec4Packed", elements / t[6]);
+}
+
+static void
+usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [--check] [--exhaustive] [--bench]\n"
+          "  --check       edge cases and random inputs in every binade (default)\n"
+          "  --exhaustive  every 32-bit input\n"
+          "  --bench       elements per second, reference and library\n",
+          argv0);
+  exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char *argv[])
+{
+  bool do_check = false, exhaustive = false, do_bench = false;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "--check") == 0)
+      do_check = true;
+    else if(strcmp(argv[i], "--exhaustive") == 0)
+      exhaustive = true;
+    else if(strcmp(argv[i], "--bench") == 0)
+      do_bench = true;
+    else
+      usage(argv[0]);
+  }
+
+  if(!do_check && !exhaustive && !do_bench)
+    do_check = true;
+
+  if(do_check)
+    check();
+
+  if(exhaustive)
+    check_exhaustive();
+
+  if(do_bench)
+    bench();
+
+  if(failures)
+  {
+    fprintf(stderr, "%d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}